@@ -58,6 +58,9 @@ static bool quit_flag = false;
 static char *prompt = "cmd> ";
 static bool has_infile = false;
 
+static bool use_linenoise = true;
+static int web_fd;
+
 /* Optional function to call as part of exit process */
 /* Maximum number of quit functions */
 
@@ -72,6 +75,90 @@ static void pop_file();
 
 static bool interpret_cmda(int argc, char *argv[]);
 
+/* Commands and parameters are also indexed by name in open-addressing hash
+ * tables, so that dispatch does not walk the sorted lists.  Both element
+ * types start with their name, which is all the tables look at.
+ */
+#define NAME_TABLE_MIN 64
+
+typedef struct {
+    void **slot;
+    size_t size; /* Power of 2 */
+    size_t count;
+} name_table_t;
+
+static name_table_t cmd_table;
+static name_table_t param_table;
+
+static inline const char *slot_name(const void *ele)
+{
+    return *(char *const *) ele;
+}
+
+/* FNV-1a */
+static size_t name_hash(const char *name)
+{
+    size_t h = 2166136261u;
+    while (*name) {
+        h ^= (unsigned char) *name++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static void name_table_free(name_table_t *t)
+{
+    if (t->slot)
+        free_array(t->slot, t->size, sizeof(void *));
+    t->slot = NULL;
+    t->size = t->count = 0;
+}
+
+static void name_table_put(name_table_t *t, void *ele);
+
+static void name_table_grow(name_table_t *t)
+{
+    name_table_t old = *t;
+    t->size = old.size ? old.size << 1 : NAME_TABLE_MIN;
+    t->count = 0;
+    t->slot = calloc_or_fail(t->size, sizeof(void *), "name_table_grow");
+    for (size_t i = 0; i < old.size; i++) {
+        if (old.slot[i])
+            name_table_put(t, old.slot[i]);
+    }
+    name_table_free(&old);
+}
+
+/* Insert element, replacing any element with the same name */
+static void name_table_put(name_table_t *t, void *ele)
+{
+    if (2 * (t->count + 1) > t->size)
+        name_table_grow(t);
+
+    size_t mask = t->size - 1;
+    size_t i = name_hash(slot_name(ele)) & mask;
+    while (t->slot[i] && strcmp(slot_name(t->slot[i]), slot_name(ele)))
+        i = (i + 1) & mask;
+    if (!t->slot[i])
+        t->count++;
+    t->slot[i] = ele;
+}
+
+static void *name_table_get(const name_table_t *t, const char *name)
+{
+    if (!t->size)
+        return NULL;
+
+    size_t mask = t->size - 1;
+    size_t i = name_hash(name) & mask;
+    while (t->slot[i]) {
+        if (!strcmp(slot_name(t->slot[i]), name))
+            return t->slot[i];
+        i = (i + 1) & mask;
+    }
+    return NULL;
+}
+
 /* Add a new command */
 void add_cmd(char *name, cmd_func_t operation, char *summary, char *param)
 {
@@ -89,6 +176,7 @@ void add_cmd(char *name, cmd_func_t operation, char *summary, char *param)
     cmd->param = param;
     cmd->next = next_cmd;
     *last_loc = cmd;
+    name_table_put(&cmd_table, cmd);
 }
 
 /* Add a new parameter */
@@ -109,53 +197,41 @@ void add_param(char *name, int *valp, char *summary, setter_func_t setter)
     param->setter = setter;
     param->next = next_param;
     *last_loc = param;
+    name_table_put(&param_table, param);
 }
 
-/* Parse a string into a command line */
-static char **parse_args(char *line, int *argcp)
-{
-    /* Must first determine how many arguments there are.
-     * Replace all white space with null characters
-     */
-    size_t len = strlen(line);
-
-    /* First copy into buffer with each substring null-terminated */
-    char *buf = malloc_or_fail(len + 1, "parse_args");
-    buf[len] = '\0';
+/* Most arguments a command line may be split into */
+#define MAX_ARGC 256
 
+/* Split a command line into arguments in place.
+ * White space in line is overwritten with null characters and argv is
+ * pointed into line, so no memory is allocated per command.
+ * Return the number of arguments, or -1 if there are more than argc_max.
+ */
+static int parse_args(char *line, char *argv[], int argc_max)
+{
     char *src = line;
-    char *dst = buf;
-    bool skipping = true;
-    int c;
     int argc = 0;
-    while ((c = *src++) != '\0') {
-        if (isspace(c)) {
-            if (!skipping) {
-                /* Hit end of word */
-                *dst++ = '\0';
-                skipping = true;
-            }
-        } else {
-            if (skipping) {
-                /* Hit start of new word */
-                argc++;
-                skipping = false;
-            }
-            *dst++ = c;
-        }
-    }
+    for (;;) {
+        while (isspace((unsigned char) *src))
+            src++;
+        if (*src == '\0')
+            break;
 
-    /* Now assemble into array of strings */
-    char **argv = calloc_or_fail(argc, sizeof(char *), "parse_args");
-    src = buf;
-    for (int i = 0; i < argc; i++) {
-        argv[i] = strsave_or_fail(src, "parse_args");
-        src += strlen(argv[i]) + 1;
+        /* Hit start of new word */
+        if (argc == argc_max)
+            return -1;
+        argv[argc++] = src;
+
+        while (*src != '\0' && !isspace((unsigned char) *src))
+            src++;
+        if (*src == '\0')
+            break;
+        /* Hit end of word */
+        *src++ = '\0';
     }
 
-    free_block(buf, len + 1);
-    *argcp = argc;
-    return argv;
+    return argc;
 }
 
 static void record_error()
@@ -173,10 +249,8 @@ static bool interpret_cmda(int argc, char *argv[])
     if (argc == 0)
         return true;
     /* Try to find matching command */
-    cmd_element_t *next_cmd = cmd_list;
+    cmd_element_t *next_cmd = name_table_get(&cmd_table, argv[0]);
     bool ok = true;
-    while (next_cmd && strcmp(argv[0], next_cmd->name) != 0)
-        next_cmd = next_cmd->next;
     if (next_cmd) {
         ok = next_cmd->operation(argc, argv);
         if (!ok)
@@ -190,19 +264,24 @@ static bool interpret_cmda(int argc, char *argv[])
     return ok;
 }
 
-/* Execute a command from a command line */
+/* Execute a command from a command line.
+ * The command line is split in place, so its content is destroyed.
+ */
 static bool interpret_cmd(char *cmdline)
 {
     if (quit_flag)
         return false;
 
-    int argc;
-    char **argv = parse_args(cmdline, &argc);
-    bool ok = interpret_cmda(argc, argv);
-    for (int i = 0; i < argc; i++)
-        free_string(argv[i]);
-    free_array(argv, argc, sizeof(char *));
+    char *argv[MAX_ARGC];
+    int argc = parse_args(cmdline, argv, MAX_ARGC);
+    if (argc < 0) {
+        report(1, "Too many arguments (limit is %d)", MAX_ARGC);
+        record_error();
+        return false;
+    }
 
+    bool ok = interpret_cmda(argc, argv);
+    report_flush();
     return ok;
 }
 
@@ -238,6 +317,8 @@ static bool do_quit(int argc, char *argv[])
         p = p->next;
         free_block(ele, sizeof(param_element_t));
     }
+    name_table_free(&cmd_table);
+    name_table_free(&param_table);
 
     while (buf_stack)
         pop_file();
@@ -320,17 +401,14 @@ static bool do_option(int argc, char *argv[])
             report(1, "Cannot parse '%s' as integer", argv[i]);
             return false;
         }
-        /* Find parameter in list */
-        param_element_t *plist = param_list;
-        while (!found && plist) {
-            if (strcmp(plist->name, name) == 0) {
-                int oldval = *plist->valp;
-                *plist->valp = value;
-                if (plist->setter)
-                    plist->setter(oldval);
-                found = true;
-            } else
-                plist = plist->next;
+        /* Find parameter in table */
+        param_element_t *plist = name_table_get(&param_table, name);
+        if (plist) {
+            int oldval = *plist->valp;
+            *plist->valp = value;
+            if (plist->setter)
+                plist->setter(oldval);
+            found = true;
         }
         /* Didn't find parameter */
         if (!found) {
@@ -391,9 +469,6 @@ static bool do_time(int argc, char *argv[])
     return ok;
 }
 
-static bool use_linenoise = true;
-static int web_fd;
-
 static bool do_web(int argc, char *argv[])
 {
     int port = 9999;
@@ -413,11 +488,19 @@ static bool do_web(int argc, char *argv[])
     return true;
 }
 
+/* Push out whatever was buffered before the flush mode changed */
+static void flush_changed(int oldval)
+{
+    report_flush();
+}
+
 /* Initialize interpreter */
 void init_cmd()
 {
     cmd_list = NULL;
     param_list = NULL;
+    name_table_free(&cmd_table);
+    name_table_free(&param_table);
     err_cnt = 0;
     quit_flag = false;
 
@@ -436,6 +519,9 @@ void init_cmd()
     add_param("error", &err_limit, "Number of errors until exit", NULL);
     add_param("echo", &echo, "Do/don't echo commands", NULL);
     add_param("entropy", &show_entropy, "Show/Hide Shannon entropy", NULL);
+    add_param("flush", &report_flush_always,
+              "Flush output after every message instead of every command",
+              flush_changed);
 
     init_in();
     init_time(&last_time);
@@ -485,16 +571,19 @@ static void init_in()
 
 /* Read command from input file.
  * When hit EOF, close that file and return NULL
+ *
+ * Whole runs of bytes up to the next newline are located with memchr and
+ * copied into linebuf at once rather than byte by byte.
  */
 static char *readline()
 {
-    char c;
-    char *lptr = linebuf;
+    size_t len = 0;
+    bool eol = false;
 
     if (!buf_stack)
         return NULL;
 
-    for (int cnt = 0; cnt < RIO_BUFSIZE - 2; cnt++) {
+    while (!eol && len < RIO_BUFSIZE - 2) {
         if (buf_stack->count <= 0) {
             /* Need to read from input file */
             buf_stack->count = read(buf_stack->fd, buf_stack->buf, RIO_BUFSIZE);
@@ -502,34 +591,34 @@ static char *readline()
             if (buf_stack->count <= 0) {
                 /* Encountered EOF */
                 pop_file();
-                if (cnt > 0) {
-                    /* Last line of file did not terminate with newline. */
-                    /*  Terminate line & return it */
-                    *lptr++ = '\n';
-                    *lptr++ = '\0';
-                    if (echo) {
-                        report_noreturn(1, prompt);
-                        report_noreturn(1, linebuf);
-                    }
-                    return linebuf;
-                }
+                if (len > 0)
+                    break;
                 return NULL;
             }
         }
 
         /* Have text in buffer */
-        c = *buf_stack->bufptr++;
-        *lptr++ = c;
-        buf_stack->count--;
-        if (c == '\n')
-            break;
+        size_t n = RIO_BUFSIZE - 2 - len;
+        if (n > buf_stack->count)
+            n = buf_stack->count;
+        char *nl = memchr(buf_stack->bufptr, '\n', n);
+        if (nl) {
+            n = nl - buf_stack->bufptr + 1;
+            eol = true;
+        }
+        memcpy(linebuf + len, buf_stack->bufptr, n);
+        buf_stack->bufptr += n;
+        buf_stack->count -= n;
+        len += n;
     }
 
-    if (c != '\n') {
-        /* Hit buffer limit.  Artificially terminate line */
-        *lptr++ = '\n';
+    if (!eol) {
+        /* Hit buffer limit or last line of file did not terminate with
+         * newline.  Artificially terminate line.
+         */
+        linebuf[len++] = '\n';
     }
-    *lptr++ = '\0';
+    linebuf[len] = '\0';
 
     if (echo) {
         report_noreturn(1, prompt);
@@ -544,6 +633,22 @@ static bool cmd_done()
     return !buf_stack || quit_flag;
 }
 
+/* Run commands from script files (-f or source) back to back.
+ * There is nothing to multiplex while a script is on top of the input stack,
+ * so skip the select() call that cmd_select() makes for every command.  Once
+ * the input is back at stdin, or the web server is listening, return to let
+ * the select loop take over.
+ */
+static void run_script()
+{
+    while (!cmd_done() && buf_stack->fd != STDIN_FILENO && web_fd <= 0) {
+        set_echo(0);
+        char *cmdline = readline();
+        if (cmdline)
+            interpret_cmd(cmdline);
+    }
+}
+
 /* Handle command processing in program that uses select as main control loop.
  * Like select, but checks whether command input either present in internal
  * buffer
@@ -554,6 +659,19 @@ static bool cmd_done()
  * If nfds == 0, this indicates that there is no pending network activity
  */
 int web_connfd;
+
+/* Run a command received by the web server, sending its output back on the
+ * connection it came from.  The web server calls this for one request at a
+ * time, so commands from all clients are serialized.
+ */
+static void web_cmd(int fd, char *cmdline)
+{
+    web_connfd = fd;
+    interpret_cmd(cmdline);
+    report_flush();
+    web_connfd = 0;
+}
+
 static int cmd_select(int nfds,
                       fd_set *readfds,
                       fd_set *writefds,
@@ -561,6 +679,7 @@ static int cmd_select(int nfds,
                       struct timeval *timeout)
 {
     int infd;
+    int web_evfd = web_pollfd();
     fd_set local_readset;
 
     if (cmd_done())
@@ -577,8 +696,8 @@ static int cmd_select(int nfds,
         FD_SET(infd, readfds);
 
         /* If web not ready listen */
-        if (web_fd != -1)
-            FD_SET(web_fd, readfds);
+        if (web_evfd >= 0)
+            FD_SET(web_evfd, readfds);
 
         if (infd == STDIN_FILENO && prompt_flag) {
             printf("%s", prompt);
@@ -588,8 +707,8 @@ static int cmd_select(int nfds,
 
         if (infd >= nfds)
             nfds = infd + 1;
-        if (web_fd >= nfds)
-            nfds = web_fd + 1;
+        if (web_evfd >= nfds)
+            nfds = web_evfd + 1;
     }
     if (nfds == 0)
         return 0;
@@ -608,22 +727,10 @@ static int cmd_select(int nfds,
         char *cmdline = readline();
         if (cmdline)
             interpret_cmd(cmdline);
-    } else if (readfds && FD_ISSET(web_fd, readfds)) {
-        FD_CLR(web_fd, readfds);
+    } else if (readfds && web_evfd >= 0 && FD_ISSET(web_evfd, readfds)) {
+        FD_CLR(web_evfd, readfds);
         result--;
-        struct sockaddr_in clientaddr;
-        socklen_t clientlen = sizeof(clientaddr);
-        web_connfd =
-            accept(web_fd, (struct sockaddr *) &clientaddr, &clientlen);
-
-        char *p = web_recv(web_connfd, &clientaddr);
-        char *buffer = "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\n\r\n";
-        web_send(web_connfd, buffer);
-
-        if (p)
-            interpret_cmd(p);
-        free(p);
-        close(web_connfd);
+        web_process(web_cmd);
     }
     return result;
 }
@@ -688,10 +795,12 @@ bool run_console(char *infile_name)
     if (!has_infile) {
         char *cmdline;
         while (use_linenoise && (cmdline = linenoise(prompt))) {
-            interpret_cmd(cmdline);
+            /* Record the line before interpret_cmd() splits it up */
             line_history_add(cmdline);       /* Add to the history. */
             line_history_save(HISTORY_FILE); /* Save the history on disk. */
+            interpret_cmd(cmdline);
             line_free(cmdline);
+            run_script();
             while (buf_stack && buf_stack->fd != STDIN_FILENO)
                 cmd_select(0, NULL, NULL, NULL, NULL);
             has_infile = false;
@@ -701,8 +810,11 @@ bool run_console(char *infile_name)
                 cmd_select(0, NULL, NULL, NULL, NULL);
         }
     } else {
-        while (!cmd_done())
-            cmd_select(0, NULL, NULL, NULL, NULL);
+        while (!cmd_done()) {
+            run_script();
+            if (!cmd_done())
+                cmd_select(0, NULL, NULL, NULL, NULL);
+        }
     }
 
     return err_cnt == 0;
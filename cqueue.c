@@ -0,0 +1,293 @@
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/* The queues are infrastructure rather than code under test */
+#define INTERNAL 1
+#include "harness.h"
+
+#include "cqueue.h"
+
+/* Keep fields written by different threads on different cache lines */
+#define CACHE_LINE 64
+
+typedef struct {
+    atomic_size_t seq;
+    element_t *e;
+} cq_cell_t;
+
+struct cq_ring {
+    _Alignas(CACHE_LINE) atomic_size_t tail; /* Next position to push to */
+    _Alignas(CACHE_LINE) atomic_size_t head; /* Next position to pop from */
+    _Alignas(CACHE_LINE) size_t mask;
+    cq_cell_t *cells;
+};
+
+cq_ring_t *cq_ring_new(size_t capacity)
+{
+    size_t size = 2;
+    while (size < capacity)
+        size <<= 1;
+
+    cq_ring_t *ring = aligned_alloc(CACHE_LINE, sizeof(cq_ring_t));
+    if (!ring)
+        return NULL;
+    ring->cells = malloc(size * sizeof(cq_cell_t));
+    if (!ring->cells) {
+        free(ring);
+        return NULL;
+    }
+
+    /* Cell i is ready for the push at position i */
+    for (size_t i = 0; i < size; i++)
+        atomic_init(&ring->cells[i].seq, i);
+    ring->mask = size - 1;
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->head, 0);
+    return ring;
+}
+
+void cq_ring_free(cq_ring_t *ring)
+{
+    if (!ring)
+        return;
+    free(ring->cells);
+    free(ring);
+}
+
+bool cq_ring_push(cq_ring_t *ring, element_t *e)
+{
+    size_t pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    cq_cell_t *cell;
+    for (;;) {
+        cell = &ring->cells[pos & ring->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+        if (diff == 0) {
+            /* The cell is free in this lap; claim the position */
+            if (atomic_compare_exchange_weak_explicit(
+                    &ring->tail, &pos, pos + 1, memory_order_relaxed,
+                    memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            /* Not yet popped from in the previous lap */
+            return false;
+        } else {
+            pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        }
+    }
+
+    cell->e = e;
+    atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+    return true;
+}
+
+element_t *cq_ring_pop(cq_ring_t *ring)
+{
+    size_t pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    cq_cell_t *cell;
+    for (;;) {
+        cell = &ring->cells[pos & ring->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t) seq - (intptr_t) (pos + 1);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(
+                    &ring->head, &pos, pos + 1, memory_order_relaxed,
+                    memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            /* Not yet pushed to in this lap */
+            return NULL;
+        } else {
+            pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+        }
+    }
+
+    element_t *e = cell->e;
+    /* Ready for the push one lap later */
+    atomic_store_explicit(&cell->seq, pos + ring->mask + 1,
+                          memory_order_release);
+    return e;
+}
+
+typedef struct cq_node {
+    _Atomic(struct cq_node *) next;
+    element_t *e;
+} cq_node_t;
+
+/* Hazard pointers a thread may hold at once, and the number of retired
+ * nodes it collects before scanning for ones no thread holds.  Scanning
+ * after twice as many retirements as there are hazard pointers frees at
+ * least half of them each time.
+ */
+#define CQ_HAZARDS 2
+#define CQ_RETIRE_MAX (2 * CQ_HAZARDS * CQ_MAX_THREADS)
+
+typedef struct {
+    _Alignas(CACHE_LINE) _Atomic(cq_node_t *) hazard[CQ_HAZARDS];
+    size_t n_retired;
+    cq_node_t *retired[CQ_RETIRE_MAX];
+} cq_thread_t;
+
+struct cq_ms {
+    _Alignas(CACHE_LINE) _Atomic(cq_node_t *) head; /* Dummy node */
+    _Alignas(CACHE_LINE) _Atomic(cq_node_t *) tail;
+    cq_thread_t threads[CQ_MAX_THREADS];
+};
+
+cq_ms_t *cq_ms_new(void)
+{
+    cq_ms_t *q = aligned_alloc(CACHE_LINE, sizeof(cq_ms_t));
+    cq_node_t *dummy = malloc(sizeof(cq_node_t));
+    if (!q || !dummy) {
+        free(q);
+        free(dummy);
+        return NULL;
+    }
+
+    atomic_init(&dummy->next, NULL);
+    dummy->e = NULL;
+    atomic_init(&q->head, dummy);
+    atomic_init(&q->tail, dummy);
+    for (int t = 0; t < CQ_MAX_THREADS; t++) {
+        for (int h = 0; h < CQ_HAZARDS; h++)
+            atomic_init(&q->threads[t].hazard[h], NULL);
+        q->threads[t].n_retired = 0;
+    }
+    return q;
+}
+
+void cq_ms_free(cq_ms_t *q)
+{
+    if (!q)
+        return;
+    for (cq_node_t *node = atomic_load(&q->head), *next; node; node = next) {
+        next = atomic_load(&node->next);
+        free(node);
+    }
+    for (int t = 0; t < CQ_MAX_THREADS; t++) {
+        for (size_t i = 0; i < q->threads[t].n_retired; i++)
+            free(q->threads[t].retired[i]);
+    }
+    free(q);
+}
+
+/* Publish that thread self is about to access the node at *src, and return
+ * it once it is certain to have been there after publishing.
+ */
+static cq_node_t *protect(cq_thread_t *self,
+                          int h,
+                          _Atomic(cq_node_t *) *src)
+{
+    cq_node_t *node = atomic_load(src), *again;
+    for (;;) {
+        atomic_store(&self->hazard[h], node);
+        again = atomic_load(src);
+        if (again == node)
+            return node;
+        node = again;
+    }
+}
+
+static int cmp_ptr(const void *a, const void *b)
+{
+    uintptr_t x = (uintptr_t) * (cq_node_t *const *) a;
+    uintptr_t y = (uintptr_t) * (cq_node_t *const *) b;
+    return (x > y) - (x < y);
+}
+
+/* Free the retired nodes no thread holds a hazard pointer to */
+static void scan(cq_ms_t *q, cq_thread_t *self)
+{
+    cq_node_t *held[CQ_MAX_THREADS * CQ_HAZARDS];
+    size_t n_held = 0;
+    for (int t = 0; t < CQ_MAX_THREADS; t++) {
+        for (int h = 0; h < CQ_HAZARDS; h++) {
+            cq_node_t *node = atomic_load(&q->threads[t].hazard[h]);
+            if (node)
+                held[n_held++] = node;
+        }
+    }
+    qsort(held, n_held, sizeof(held[0]), cmp_ptr);
+
+    size_t kept = 0;
+    for (size_t i = 0; i < self->n_retired; i++) {
+        cq_node_t *node = self->retired[i];
+        if (bsearch(&node, held, n_held, sizeof(held[0]), cmp_ptr))
+            self->retired[kept++] = node;
+        else
+            free(node);
+    }
+    self->n_retired = kept;
+}
+
+static void retire(cq_ms_t *q, cq_thread_t *self, cq_node_t *node)
+{
+    self->retired[self->n_retired++] = node;
+    if (self->n_retired == CQ_RETIRE_MAX)
+        scan(q, self);
+}
+
+bool cq_ms_push(cq_ms_t *q, int tid, element_t *e)
+{
+    cq_node_t *node = malloc(sizeof(cq_node_t));
+    if (!node)
+        return false;
+    atomic_init(&node->next, NULL);
+    node->e = e;
+
+    cq_thread_t *self = &q->threads[tid];
+    for (;;) {
+        cq_node_t *tail = protect(self, 0, &q->tail);
+        cq_node_t *next = atomic_load(&tail->next);
+        if (tail != atomic_load(&q->tail))
+            continue;
+        if (next) {
+            /* Help a push that linked its node but has not moved tail */
+            atomic_compare_exchange_weak(&q->tail, &tail, next);
+            continue;
+        }
+        cq_node_t *expected = NULL;
+        if (atomic_compare_exchange_weak(&tail->next, &expected, node)) {
+            atomic_compare_exchange_strong(&q->tail, &tail, node);
+            break;
+        }
+    }
+    atomic_store(&self->hazard[0], NULL);
+    return true;
+}
+
+element_t *cq_ms_pop(cq_ms_t *q, int tid)
+{
+    cq_thread_t *self = &q->threads[tid];
+    cq_node_t *head;
+    element_t *e;
+    for (;;) {
+        head = protect(self, 0, &q->head);
+        cq_node_t *tail = atomic_load(&q->tail);
+        cq_node_t *next = protect(self, 1, &head->next);
+        if (head != atomic_load(&q->head))
+            continue;
+        if (!next) {
+            e = NULL;
+            head = NULL;
+            break;
+        }
+        if (head == tail) {
+            /* Tail lags behind a linked node; move it before going on */
+            atomic_compare_exchange_weak(&q->tail, &tail, next);
+            continue;
+        }
+        /* Read before the swap, after which next may be popped and freed */
+        e = next->e;
+        if (atomic_compare_exchange_weak(&q->head, &head, next))
+            break;
+    }
+    atomic_store(&self->hazard[0], NULL);
+    atomic_store(&self->hazard[1], NULL);
+
+    /* The old dummy node is unlinked; next is the new one */
+    if (head)
+        retire(q, self, head);
+    return e;
+}
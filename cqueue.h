@@ -0,0 +1,95 @@
+#ifndef LAB0_CQUEUE_H
+#define LAB0_CQUEUE_H
+
+/* Concurrent queues of element_t, for passing elements between producer and
+ * consumer threads without a lock around q_insert_tail() and q_remove_head().
+ *
+ * cq_ring_t is a bounded multi-producer multi-consumer ring after Dmitry
+ * Vyukov: every cell carries a sequence number telling whether it is ready
+ * to be written or read in the current lap, so a push or pop costs one
+ * compare-and-swap on the shared position and touches no other shared state.
+ *
+ * cq_ms_t is the unbounded linked queue of Michael and Scott (PODC 1996).
+ * Dequeued nodes are reclaimed with hazard pointers (Michael, 2004), which
+ * need every thread to name itself: pass a distinct tid below
+ * CQ_MAX_THREADS from each thread using the same queue.
+ *
+ * Neither queue owns the elements: freeing a queue leaves the elements still
+ * in it alone, so drain it first.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "queue.h"
+
+/* Threads that may use one cq_ms_t */
+#define CQ_MAX_THREADS 64
+
+typedef struct cq_ring cq_ring_t;
+typedef struct cq_ms cq_ms_t;
+
+/**
+ * cq_ring_new() - Create an empty ring
+ * @capacity: number of elements it can hold, rounded up to a power of two
+ *
+ * Return: NULL for allocation failed
+ */
+cq_ring_t *cq_ring_new(size_t capacity);
+
+/**
+ * cq_ring_free() - Free a ring, but not the elements left in it
+ * @ring: ring no other thread is using any more
+ */
+void cq_ring_free(cq_ring_t *ring);
+
+/**
+ * cq_ring_push() - Append an element
+ * @ring: ring to append to
+ * @e: element to append
+ *
+ * Return: false if the ring is full
+ */
+bool cq_ring_push(cq_ring_t *ring, element_t *e);
+
+/**
+ * cq_ring_pop() - Take the oldest element
+ * @ring: ring to take from
+ *
+ * Return: the element, or NULL if the ring is empty
+ */
+element_t *cq_ring_pop(cq_ring_t *ring);
+
+/**
+ * cq_ms_new() - Create an empty linked queue
+ *
+ * Return: NULL for allocation failed
+ */
+cq_ms_t *cq_ms_new(void);
+
+/**
+ * cq_ms_free() - Free a linked queue, but not the elements left in it
+ * @q: queue no other thread is using any more
+ */
+void cq_ms_free(cq_ms_t *q);
+
+/**
+ * cq_ms_push() - Append an element
+ * @q: queue to append to
+ * @tid: index of the calling thread, below CQ_MAX_THREADS
+ * @e: element to append
+ *
+ * Return: false if no node could be allocated
+ */
+bool cq_ms_push(cq_ms_t *q, int tid, element_t *e);
+
+/**
+ * cq_ms_pop() - Take the oldest element
+ * @q: queue to take from
+ * @tid: index of the calling thread, below CQ_MAX_THREADS
+ *
+ * Return: the element, or NULL if the queue is empty
+ */
+element_t *cq_ms_pop(cq_ms_t *q, int tid);
+
+#endif /* LAB0_CQUEUE_H */
@@ -0,0 +1,205 @@
+/* Stress test and throughput benchmark of the concurrent queues in cqueue.c
+ * against a list guarded by a mutex, the way queues were shared between
+ * threads before.  For 1 to N producers and as many consumers, every queue
+ * passes the same elements from producers to consumers, which check that
+ * each element arrives exactly once and that those of one producer arrive in
+ * the order they were sent.
+ *
+ * Usage: cqueue_bench [max threads per side] [elements per producer]
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define INTERNAL 1
+#include "harness.h"
+
+#include "cqueue.h"
+#include "list.h"
+
+#define DEFAULT_ELEMENTS 200000
+#define RING_CAPACITY 1024
+#define MAX_SIDE (CQ_MAX_THREADS / 2)
+
+typedef enum { KIND_MUTEX, KIND_RING, KIND_MS, N_KINDS } kind_t;
+
+static const char *kind_names[] = {"mutex list", "vyukov ring", "ms queue"};
+
+/* The queue under test */
+static kind_t kind;
+static cq_ring_t *ring;
+static cq_ms_t *ms;
+static struct list_head locked_list;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static element_t *elements;
+static int producers, consumers;
+static size_t per_producer;
+static atomic_size_t consumed;
+static atomic_int errors;
+static unsigned char *seen;
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1.0E-9 * ts.tv_nsec;
+}
+
+static bool push(int tid, element_t *e)
+{
+    switch (kind) {
+    case KIND_RING:
+        return cq_ring_push(ring, e);
+    case KIND_MS:
+        return cq_ms_push(ms, tid, e);
+    default:
+        pthread_mutex_lock(&lock);
+        list_add_tail(&e->list, &locked_list);
+        pthread_mutex_unlock(&lock);
+        return true;
+    }
+}
+
+static element_t *pop(int tid)
+{
+    element_t *e = NULL;
+    switch (kind) {
+    case KIND_RING:
+        return cq_ring_pop(ring);
+    case KIND_MS:
+        return cq_ms_pop(ms, tid);
+    default:
+        pthread_mutex_lock(&lock);
+        if (!list_empty(&locked_list)) {
+            e = list_first_entry(&locked_list, element_t, list);
+            list_del(&e->list);
+        }
+        pthread_mutex_unlock(&lock);
+        return e;
+    }
+}
+
+static void *producer(void *arg)
+{
+    int p = (int) (intptr_t) arg;
+    element_t *mine = elements + p * per_producer;
+    for (size_t i = 0; i < per_producer; i++) {
+        /* A full ring, or one core shared by all threads */
+        while (!push(p, &mine[i]))
+            sched_yield();
+    }
+    return NULL;
+}
+
+static void *consumer(void *arg)
+{
+    int tid = (int) (intptr_t) arg;
+    size_t total = producers * per_producer;
+    size_t *last = calloc(producers, sizeof(size_t));
+    if (!last) {
+        atomic_fetch_add(&errors, 1);
+        return NULL;
+    }
+
+    while (atomic_load_explicit(&consumed, memory_order_relaxed) < total) {
+        element_t *e = pop(tid);
+        if (!e) {
+            sched_yield();
+            continue;
+        }
+        size_t index = e - elements;
+        size_t p = index / per_producer, seq = index % per_producer + 1;
+        if (index >= total || seen[index]++ || seq <= last[p])
+            atomic_fetch_add(&errors, 1);
+        last[p] = seq;
+        atomic_fetch_add_explicit(&consumed, 1, memory_order_relaxed);
+    }
+    free(last);
+    return NULL;
+}
+
+/* Pass every element through the queue, and return elements per second */
+static double run(kind_t k, int n)
+{
+    kind = k;
+    producers = consumers = n;
+    size_t total = n * per_producer;
+    memset(seen, 0, total);
+    atomic_store(&consumed, 0);
+    INIT_LIST_HEAD(&locked_list);
+    if (k == KIND_RING && !(ring = cq_ring_new(RING_CAPACITY)))
+        return 0;
+    if (k == KIND_MS && !(ms = cq_ms_new()))
+        return 0;
+
+    pthread_t threads[2 * MAX_SIDE];
+    double start = now();
+    for (int i = 0; i < n; i++) {
+        pthread_create(&threads[i], NULL, producer, (void *) (intptr_t) i);
+        pthread_create(&threads[n + i], NULL, consumer,
+                       (void *) (intptr_t) (n + i));
+    }
+    for (int i = 0; i < 2 * n; i++)
+        pthread_join(threads[i], NULL);
+    double elapsed = now() - start;
+
+    for (size_t i = 0; i < total; i++) {
+        if (seen[i] != 1) {
+            atomic_fetch_add(&errors, 1);
+            break;
+        }
+    }
+    if (k == KIND_RING)
+        cq_ring_free(ring);
+    if (k == KIND_MS)
+        cq_ms_free(ms);
+    return total / elapsed;
+}
+
+int main(int argc, char *argv[])
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int max = argc > 1 ? atoi(argv[1]) : (cpus > 1 ? cpus / 2 : 1);
+    per_producer = argc > 2 ? strtoul(argv[2], NULL, 10) : DEFAULT_ELEMENTS;
+    if (max < 1 || max > MAX_SIDE || per_producer < 1) {
+        fprintf(stderr, "usage: %s [threads per side, 1-%d] [elements]\n",
+                argv[0], MAX_SIDE);
+        return EXIT_FAILURE;
+    }
+
+    size_t most = max * per_producer;
+    elements = calloc(most, sizeof(element_t));
+    seen = malloc(most);
+    if (!elements || !seen)
+        return EXIT_FAILURE;
+    for (size_t i = 0; i < most; i++)
+        elements[i].value = "cqueue";
+
+    printf("%zu elements per producer, %ld cores\n", per_producer, cpus);
+    printf("%-9s", "threads");
+    for (kind_t k = 0; k < N_KINDS; k++)
+        printf("%16s", kind_names[k]);
+    printf("   (million elements/s)\n");
+    /* Powers of two, and max itself */
+    for (int n = 1;; n = n * 2 < max ? n * 2 : max) {
+        printf("%2d + %-4d", n, n);
+        for (kind_t k = 0; k < N_KINDS; k++)
+            printf("%16.2f", run(k, n) / 1.0E6);
+        printf("\n");
+        if (n == max)
+            break;
+    }
+
+    int bad = atomic_load(&errors);
+    printf("%d elements lost, duplicated or out of order\n", bad);
+    free(seen);
+    free(elements);
+    return bad ? EXIT_FAILURE : EXIT_SUCCESS;
+}
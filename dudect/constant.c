@@ -12,37 +12,50 @@
  */
 static struct list_head *l = NULL;
 
-#define dut_new() ((void) (l = q_new()))
-
-#define dut_size(n)                                \
-    do {                                           \
-        for (int __iter = 0; __iter < n; ++__iter) \
-            q_size(l);                             \
-    } while (0)
-
-#define dut_insert_head(s, n)    \
-    do {                         \
-        int j = n;               \
-        while (j--)              \
-            q_insert_head(l, s); \
-    } while (0)
-
-#define dut_insert_tail(s, n)    \
-    do {                         \
-        int j = n;               \
-        while (j--)              \
-            q_insert_tail(l, s); \
-    } while (0)
-
-#define dut_free() ((void) (q_free(l)))
+/* A second queue, and the chain holding both, for q_merge() */
+static struct list_head *l2 = NULL;
+static queue_contex_t contexts[2];
+static LIST_HEAD(chain);
+
+/* Operations whose time legitimately depends on the queue length are tested
+ * on queues of this length, with equal values for class 0 and random values
+ * for class 1, rather than on an empty queue against a random length.
+ */
+#define FIXED_SIZE 512
 
 static char random_string[N_MEASURES][8];
 static int random_string_iter = 0;
+static const char fixed_string[] = "dudect";
+
+/* State shared by the setup, call and check of the operation under test */
+static char *arg;
+static int before_size;
+static element_t *removed;
+static int result;
+
+/* One operation under test.
+ * @by_size: class 0 is an empty queue, class 1 one of random length, as
+ *           expected to make no difference for O(1) operations
+ * @extra: nodes to add to the queue so that the call has work to do
+ * @setup: build the queues the call works on, n values long
+ * @call: the measured call, and nothing else
+ * @check: verify the effect of the call and free the queues
+ */
+typedef struct {
+    const char *name;
+    bool by_size;
+    size_t extra;
+    void (*setup)(size_t n, bool random);
+    void (*call)(void);
+    bool (*check)(void);
+} dut_t;
 
 /* Implement the necessary queue interface to simulation */
 void init_dut(void)
 {
+    cpucycles_calibrate();
     l = NULL;
+    l2 = NULL;
 }
 
 static char *get_random_string(void)
@@ -67,96 +80,245 @@ void prepare_inputs(uint8_t *input_data, uint8_t *classes)
     }
 }
 
+/* Count the nodes without trusting q_size(), which may be under test */
+static int count(struct list_head *head)
+{
+    int n = 0;
+    struct list_head *node;
+    list_for_each (node, head)
+        n++;
+    return n;
+}
+
+static struct list_head *new_queue(size_t n, bool random)
+{
+    struct list_head *q = q_new();
+    for (size_t j = 0; q && j < n; j++)
+        q_insert_head(q, random ? get_random_string() : (char *) fixed_string);
+    return q;
+}
+
+static void setup_queue(size_t n, bool random)
+{
+    l = new_queue(n, random);
+    arg = get_random_string();
+    before_size = l ? count(l) : -1;
+}
+
+/* Two sorted queues of about n / 2 values each, chained for q_merge() */
+static void setup_merge(size_t n, bool random)
+{
+    l = new_queue(n / 2, random);
+    l2 = new_queue(n - n / 2, random);
+    if (l)
+        q_sort(l, false);
+    if (l2)
+        q_sort(l2, false);
+
+    INIT_LIST_HEAD(&chain);
+    contexts[0].q = l;
+    contexts[1].q = l2;
+    for (int i = 0; i < 2; i++) {
+        contexts[i].size = contexts[i].q ? count(contexts[i].q) : 0;
+        contexts[i].id = i;
+        list_add_tail(&contexts[i].chain, &chain);
+    }
+    before_size = contexts[0].size + contexts[1].size;
+}
+
+static void call_insert_head(void)
+{
+    q_insert_head(l, arg);
+}
+
+static void call_insert_tail(void)
+{
+    q_insert_tail(l, arg);
+}
+
+static void call_remove_head(void)
+{
+    removed = q_remove_head(l, NULL, 0);
+}
+
+static void call_remove_tail(void)
+{
+    removed = q_remove_tail(l, NULL, 0);
+}
+
+static void call_size(void)
+{
+    result = q_size(l);
+}
+
+static void call_reverse(void)
+{
+    q_reverse(l);
+}
+
+static void call_delete_mid(void)
+{
+    q_delete_mid(l);
+}
+
+static void call_swap(void)
+{
+    q_swap(l);
+}
+
+static void call_sort(void)
+{
+    q_sort(l, false);
+}
+
+static void call_merge(void)
+{
+    result = q_merge(&chain, false);
+}
+
+static bool is_sorted(struct list_head *head)
+{
+    for (struct list_head *p = head->next; p != head && p->next != head;
+         p = p->next) {
+        if (strcmp(list_entry(p, element_t, list)->value,
+                   list_entry(p->next, element_t, list)->value) > 0)
+            return false;
+    }
+    return true;
+}
+
+/* Verify that the queue grew or shrank by delta, and free it */
+static bool check_delta(int delta)
+{
+    int after_size = l ? count(l) : -1;
+    q_free(l);
+    return before_size >= 0 && after_size == before_size + delta;
+}
+
+static bool check_grown(void)
+{
+    return check_delta(1);
+}
+
+static bool check_removed(void)
+{
+    if (removed)
+        q_release_element(removed);
+    /* Check, and free, the queue even if nothing was removed */
+    bool ok = check_delta(-1) && removed;
+    removed = NULL;
+    return ok;
+}
+
+static bool check_deleted(void)
+{
+    return check_delta(-1);
+}
+
+static bool check_size(void)
+{
+    return result == before_size && check_delta(0);
+}
+
+static bool check_same(void)
+{
+    return check_delta(0);
+}
+
+static bool check_sorted(void)
+{
+    bool ok = l && is_sorted(l);
+    return check_delta(0) && ok;
+}
+
+static bool check_merge(void)
+{
+    bool ok = l && l2 && result == before_size && count(l) == before_size &&
+              list_empty(l2) && is_sorted(l);
+    q_free(l);
+    q_free(l2);
+    return ok;
+}
+
+static const dut_t duts[] = {
+    [DUT(insert_head)] = {"insert_head", true, 0, setup_queue,
+                          call_insert_head, check_grown},
+    [DUT(insert_tail)] = {"insert_tail", true, 0, setup_queue,
+                          call_insert_tail, check_grown},
+    [DUT(remove_head)] = {"remove_head", true, 1, setup_queue,
+                          call_remove_head, check_removed},
+    [DUT(remove_tail)] = {"remove_tail", true, 1, setup_queue,
+                          call_remove_tail, check_removed},
+    [DUT(size)] = {"size", false, 0, setup_queue, call_size, check_size},
+    [DUT(reverse)] = {"reverse", false, 0, setup_queue, call_reverse,
+                      check_same},
+    [DUT(delete_mid)] = {"delete_mid", false, 1, setup_queue,
+                         call_delete_mid, check_deleted},
+    [DUT(swap)] = {"swap", false, 0, setup_queue, call_swap, check_same},
+    [DUT(sort)] = {"sort", false, 0, setup_queue, call_sort, check_sorted},
+    [DUT(merge)] = {"merge", false, 0, setup_merge, call_merge,
+                    check_merge},
+};
+
+/* A timed read right after the setup waits for the work the setup left in
+ * flight, which grows with the queue, so do one whose result is dropped.
+ */
+static inline void settle(void)
+{
+    cpucycles_start();
+    cpucycles_end();
+}
+
 bool measure(int64_t *before_ticks,
              int64_t *after_ticks,
              uint8_t *input_data,
              int mode)
 {
-    assert(mode == DUT(insert_head) || mode == DUT(insert_tail) ||
-           mode == DUT(remove_head) || mode == DUT(remove_tail));
-
-    switch (mode) {
-    case DUT(insert_head):
-        for (size_t i = DROP_SIZE; i < N_MEASURES - DROP_SIZE; i++) {
-            char *s = get_random_string();
-            dut_new();
-            dut_insert_head(
-                get_random_string(),
-                *(uint16_t *) (input_data + i * CHUNK_SIZE) % 10000);
-            int before_size = q_size(l);
-            before_ticks[i] = cpucycles();
-            dut_insert_head(s, 1);
-            after_ticks[i] = cpucycles();
-            int after_size = q_size(l);
-            dut_free();
-            if (before_size != after_size - 1)
-                return false;
-        }
-        break;
-    case DUT(insert_tail):
-        for (size_t i = DROP_SIZE; i < N_MEASURES - DROP_SIZE; i++) {
-            char *s = get_random_string();
-            dut_new();
-            dut_insert_head(
-                get_random_string(),
-                *(uint16_t *) (input_data + i * CHUNK_SIZE) % 10000);
-            int before_size = q_size(l);
-            before_ticks[i] = cpucycles();
-            dut_insert_tail(s, 1);
-            after_ticks[i] = cpucycles();
-            int after_size = q_size(l);
-            dut_free();
-            if (before_size != after_size - 1)
-                return false;
-        }
-        break;
-    case DUT(remove_head):
-        for (size_t i = DROP_SIZE; i < N_MEASURES - DROP_SIZE; i++) {
-            dut_new();
-            dut_insert_head(
-                get_random_string(),
-                *(uint16_t *) (input_data + i * CHUNK_SIZE) % 10000 + 1);
-            int before_size = q_size(l);
-            before_ticks[i] = cpucycles();
-            element_t *e = q_remove_head(l, NULL, 0);
-            after_ticks[i] = cpucycles();
-            int after_size = q_size(l);
-            if (e)
-                q_release_element(e);
-            dut_free();
-            if (before_size != after_size + 1)
-                return false;
-        }
-        break;
-    case DUT(remove_tail):
-        for (size_t i = DROP_SIZE; i < N_MEASURES - DROP_SIZE; i++) {
-            dut_new();
-            dut_insert_head(
-                get_random_string(),
-                *(uint16_t *) (input_data + i * CHUNK_SIZE) % 10000 + 1);
-            int before_size = q_size(l);
-            before_ticks[i] = cpucycles();
-            element_t *e = q_remove_tail(l, NULL, 0);
-            after_ticks[i] = cpucycles();
-            int after_size = q_size(l);
-            if (e)
-                q_release_element(e);
-            dut_free();
-            if (before_size != after_size + 1)
-                return false;
-        }
-        break;
-    default:
-        for (size_t i = DROP_SIZE; i < N_MEASURES - DROP_SIZE; i++) {
-            dut_new();
-            dut_insert_head(
-                get_random_string(),
-                *(uint16_t *) (input_data + i * CHUNK_SIZE) % 10000);
-            before_ticks[i] = cpucycles();
-            dut_size(1);
-            after_ticks[i] = cpucycles();
-            dut_free();
-        }
+    assert(mode >= 0 && mode < N_DUTS);
+    const dut_t *d = &duts[mode];
+
+    for (size_t i = DROP_SIZE; i < N_MEASURES - DROP_SIZE; i++) {
+        uint16_t input = *(uint16_t *) (input_data + i * CHUNK_SIZE);
+        if (d->by_size)
+            d->setup(input % 10000 + d->extra, true);
+        else
+            d->setup(FIXED_SIZE + d->extra, input != 0);
+        settle();
+        before_ticks[i] = cpucycles_start();
+        d->call();
+        after_ticks[i] = cpucycles_end();
+        if (!d->check())
+            return false;
     }
     return true;
 }
+
+int64_t measure_once(int mode, size_t n)
+{
+    assert(mode >= 0 && mode < N_DUTS);
+    const dut_t *d = &duts[mode];
+
+    int64_t overhead = cpucycles_calibrate()->overhead;
+    d->setup(n + d->extra, true);
+    settle();
+    int64_t before = cpucycles_start();
+    d->call();
+    int64_t after = cpucycles_end();
+    if (!d->check())
+        return -1;
+    return after - before > overhead ? after - before - overhead : 0;
+}
+
+const char *dut_name(int mode)
+{
+    return mode >= 0 && mode < N_DUTS ? duts[mode].name : NULL;
+}
+
+int dut_lookup(const char *name)
+{
+    for (int i = 0; i < N_DUTS; i++) {
+        if (!strcmp(duts[i].name, name))
+            return i;
+    }
+    return -1;
+}
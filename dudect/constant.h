@@ -2,6 +2,7 @@
 #define DUDECT_CONSTANT_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 /* Number of measurements per test */
@@ -16,7 +17,13 @@
     _(insert_head) \
     _(insert_tail) \
     _(remove_head) \
-    _(remove_tail)
+    _(remove_tail) \
+    _(size)        \
+    _(reverse)     \
+    _(delete_mid)  \
+    _(swap)        \
+    _(sort)        \
+    _(merge)
 
 #define DUT(x) DUT_##x
 
@@ -24,6 +31,7 @@ enum {
 #define _(x) DUT(x),
     DUT_FUNCS
 #undef _
+        N_DUTS,
 };
 
 void init_dut();
@@ -33,4 +41,14 @@ bool measure(int64_t *before_ticks,
              uint8_t *input_data,
              int mode);
 
+/* Cycles taken by one call of operation mode on a queue of n random values,
+ * less the overhead of timing it, or a negative value if the operation
+ * misbehaved.
+ */
+int64_t measure_once(int mode, size_t n);
+
+/* Name of operation mode, and the mode of a name (-1 if unknown) */
+const char *dut_name(int mode);
+int dut_lookup(const char *name);
+
 #endif
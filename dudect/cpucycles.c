@@ -0,0 +1,62 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "cpucycles.h"
+
+#define CALIBRATE_SAMPLES 10001
+
+/* How long to compare the counter against the monotonic clock */
+#define CALIBRATE_NS 10000000
+
+static int cmp_int64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *) a, y = *(const int64_t *) b;
+    return (x > y) - (x < y);
+}
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+const cpucycles_info_t *cpucycles_calibrate(void)
+{
+    static cpucycles_info_t info;
+    static bool calibrated = false;
+    if (calibrated)
+        return &info;
+
+    static int64_t samples[CALIBRATE_SAMPLES];
+
+    /* The median of empty measurements, which every measurement includes */
+    for (int i = 0; i < CALIBRATE_SAMPLES; i++) {
+        int64_t before = cpucycles_start();
+        int64_t after = cpucycles_end();
+        samples[i] = after - before;
+    }
+    qsort(samples, CALIBRATE_SAMPLES, sizeof(int64_t), cmp_int64);
+    info.overhead = samples[CALIBRATE_SAMPLES / 2];
+
+    /* Counters ticking slower than the core advance in steps, if at all,
+     * between back to back reads.
+     */
+    info.resolution = INT64_MAX;
+    for (int i = 0; i < CALIBRATE_SAMPLES; i++) {
+        int64_t before = cpucycles_start(), after;
+        while ((after = cpucycles_start()) == before)
+            ;
+        if (after - before < info.resolution)
+            info.resolution = after - before;
+    }
+
+    int64_t start_ns = now_ns(), start = cpucycles_start(), ns;
+    while ((ns = now_ns() - start_ns) < CALIBRATE_NS)
+        ;
+    info.ticks_per_ns = (double) (cpucycles_end() - start) / ns;
+
+    calibrated = true;
+    return &info;
+}
@@ -26,4 +26,61 @@ static inline int64_t cpucycles(void)
 #endif
 }
 
+/* A bare read of the counter may be executed out of order with the code
+ * around it, which smears the timing of operations only tens of cycles long.
+ * Bracket the measured code with cpucycles_start() and cpucycles_end()
+ * instead: the former waits for earlier instructions to complete and keeps
+ * later ones from starting before the read, the latter waits for the
+ * measured code to complete.
+ */
+static inline int64_t cpucycles_start(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    unsigned int hi, lo;
+    __asm__ volatile("lfence\n\trdtsc\n\tlfence\n\t"
+                     : "=a"(lo), "=d"(hi)
+                     :
+                     : "memory");
+    return ((int64_t) lo) | (((int64_t) hi) << 32);
+
+#elif defined(__aarch64__)
+    uint64_t val;
+    asm volatile("isb\n\tmrs %0, cntvct_el0\n\tisb" : "=r"(val) : : "memory");
+    return val;
+#else
+#error Unsupported Architecture
+#endif
+}
+
+static inline int64_t cpucycles_end(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    unsigned int hi, lo, aux;
+    /* rdtscp waits for every earlier instruction, but not for later ones */
+    __asm__ volatile("rdtscp\n\tlfence\n\t"
+                     : "=a"(lo), "=d"(hi), "=c"(aux)
+                     :
+                     : "memory");
+    (void) aux;
+    return ((int64_t) lo) | (((int64_t) hi) << 32);
+
+#elif defined(__aarch64__)
+    uint64_t val;
+    asm volatile("isb\n\tmrs %0, cntvct_el0" : "=r"(val) : : "memory");
+    return val;
+#else
+#error Unsupported Architecture
+#endif
+}
+
+/* Properties of the counter, measured by cpucycles_calibrate() */
+typedef struct {
+    int64_t overhead;   /* Ticks between an empty start and end */
+    int64_t resolution; /* Smallest step the counter was seen to take */
+    double ticks_per_ns;
+} cpucycles_info_t;
+
+/* Measure the counter once, and return what was found */
+const cpucycles_info_t *cpucycles_calibrate(void);
+
 #endif
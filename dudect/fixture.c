@@ -26,25 +26,62 @@
  *    variable time.
  */
 
+/* sched_setaffinity and the CPU_* macros are GNU extensions on Linux */
+#if defined(__linux__)
+#define _GNU_SOURCE
+#include <sched.h>
+#endif
+
 #include <assert.h>
+#include <errno.h>
 #include <math.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #include "../console.h"
 #include "../random.h"
 
 #include "constant.h"
+#include "cpucycles.h"
 #include "fixture.h"
 #include "ttest.h"
 
 #define ENOUGH_MEASURE 10000
 #define TEST_TRIES 10
 
+/* Upper bound on measurement processes run side by side */
+#define MAX_WORKERS 64
+
+/* Every measurement feeds several t-tests: the uncropped one, one per
+ * percentile threshold, and a second-order one.
+ */
+#define N_PERCENTILES 100
+#define TEST_UNCROPPED 0
+#define TEST_CROPPED(i) (1 + (i))
+#define TEST_SECOND_ORDER (1 + N_PERCENTILES)
+#define N_TESTS (2 + N_PERCENTILES)
+
+/* The second-order test centres measurements on the mean of the uncropped
+ * test, so wait until that mean has settled.
+ */
+#define SECOND_ORDER_WARMUP 1000
+
+/* Fewest measurements a test needs before it may decide the verdict */
+#define ENOUGH_PER_TEST (ENOUGH_MEASURE / 10)
+
 static t_context_t *t;
 
+/* Cropping thresholds, in increasing order, taken from the first batch */
+static int64_t percentiles[N_PERCENTILES];
+static bool have_percentiles;
+
+int dudect_cpus = 1;
+int dudect_crop = 0;
+
 /* threshold values for Welch's t-test */
 enum {
     t_threshold_bananas = 500, /* Test failed with overwhelming probability */
@@ -60,8 +97,41 @@ static void differentiate(int64_t *exec_times,
                           const int64_t *before_ticks,
                           const int64_t *after_ticks)
 {
-    for (size_t i = 0; i < N_MEASURES; i++)
-        exec_times[i] = after_ticks[i] - before_ticks[i];
+    /* Leave out the time taken by reading the counter itself */
+    int64_t overhead = cpucycles_calibrate()->overhead;
+    for (size_t i = 0; i < N_MEASURES; i++) {
+        int64_t ticks = after_ticks[i] - before_ticks[i];
+        exec_times[i] = ticks > overhead ? ticks - overhead : 0;
+    }
+}
+
+static int cmp_int64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *) a, y = *(const int64_t *) b;
+    return (x > y) - (x < y);
+}
+
+/* Spread the thresholds so that the tightest keeps only the fastest few
+ * percent of measurements and the loosest nearly all of them, as in the
+ * reference dudect.
+ */
+static void prepare_percentiles(const int64_t *exec_times)
+{
+    int64_t sorted[N_MEASURES];
+    size_t n = 0;
+    for (size_t i = 0; i < N_MEASURES; i++) {
+        if (exec_times[i] > 0)
+            sorted[n++] = exec_times[i];
+    }
+    if (!n)
+        return;
+    qsort(sorted, n, sizeof(sorted[0]), cmp_int64);
+
+    for (size_t i = 0; i < N_PERCENTILES; i++) {
+        double which = 1 - pow(0.5, 10 * (double) (i + 1) / N_PERCENTILES);
+        percentiles[i] = sorted[(size_t) (which * n)];
+    }
+    have_percentiles = true;
 }
 
 static void update_statistics(const int64_t *exec_times, uint8_t *classes)
@@ -73,24 +143,60 @@ static void update_statistics(const int64_t *exec_times, uint8_t *classes)
             continue;
 
         /* do a t-test on the execution time */
-        t_push(t, difference, classes[i]);
+        t_push(&t[TEST_UNCROPPED], difference, classes[i]);
+
+        /* do a t-test on cropped execution times, for several thresholds */
+        for (int p = N_PERCENTILES - 1; p >= 0 && difference < percentiles[p];
+             p--)
+            t_push(&t[TEST_CROPPED(p)], difference, classes[i]);
+
+        /* do a second-order test (only if we have more than a few
+         * measurements) on the centred product, which is sensitive to a
+         * difference in variance rather than in mean.
+         */
+        if (t[TEST_UNCROPPED].n[0] > SECOND_ORDER_WARMUP) {
+            double centred = difference - t[TEST_UNCROPPED].mean[classes[i]];
+            t_push(&t[TEST_SECOND_ORDER], centred * centred, classes[i]);
+        }
     }
 }
 
+/* The test with the largest |t| among those with enough measurements */
+static int max_test(void)
+{
+    int ret = TEST_UNCROPPED;
+    double max = 0;
+    for (int i = 0; dudect_crop && i < N_TESTS; i++) {
+        if (t[i].n[0] + t[i].n[1] < ENOUGH_PER_TEST || t[i].n[0] < 2 ||
+            t[i].n[1] < 2)
+            continue;
+        double x = fabs(t_compute(&t[i]));
+        if (x > max) {
+            max = x;
+            ret = i;
+        }
+    }
+    return ret;
+}
+
 static bool report(void)
 {
-    double max_t = fabs(t_compute(t));
-    double number_traces_max_t = t->n[0] + t->n[1];
-    double max_tau = max_t / sqrt(number_traces_max_t);
+    double number_measurements =
+        t[TEST_UNCROPPED].n[0] + t[TEST_UNCROPPED].n[1];
 
     printf("\033[A\033[2K");
-    printf("meas: %7.2lf M, ", (number_traces_max_t / 1e6));
-    if (number_traces_max_t < ENOUGH_MEASURE) {
+    printf("meas: %7.2lf M, ", (number_measurements / 1e6));
+    if (number_measurements < ENOUGH_MEASURE) {
         printf("not enough measurements (%.0f still to go).\n",
-               ENOUGH_MEASURE - number_traces_max_t);
+               ENOUGH_MEASURE - number_measurements);
         return false;
     }
 
+    int mt = max_test();
+    double max_t = fabs(t_compute(&t[mt]));
+    double number_traces_max_t = t[mt].n[0] + t[mt].n[1];
+    double max_tau = max_t / sqrt(number_traces_max_t);
+
     /* max_t: the t statistic value
      * max_tau: a t value normalized by sqrt(number of measurements).
      *          this way we can compare max_tau taken with different
@@ -101,8 +207,15 @@ static bool report(void)
      *            detect the leak, if present. "barely detect the
      *            leak" = have a t value greater than 5.
      */
-    printf("max t: %+7.2f, max tau: %.2e, (5/tau)^2: %.2e.\n", max_t, max_tau,
+    printf("max t: %+7.2f, max tau: %.2e, (5/tau)^2: %.2e, ", max_t, max_tau,
            (double) (5 * 5) / (double) (max_tau * max_tau));
+    if (mt == TEST_UNCROPPED)
+        printf("uncropped.\n");
+    else if (mt == TEST_SECOND_ORDER)
+        printf("second order.\n");
+    else
+        printf("cropped at %ld cycles.\n",
+               (long) percentiles[mt - TEST_CROPPED(0)]);
 
     /* Definitely not constant time */
     if (max_t > t_threshold_bananas)
@@ -116,7 +229,10 @@ static bool report(void)
     return true;
 }
 
-static bool doit(int mode)
+/* Run one batch of measurements into t, or into the cropping thresholds if
+ * they are not known yet.  Return false if the operation misbehaved.
+ */
+static bool measure_batch(int mode)
 {
     int64_t *before_ticks = calloc(N_MEASURES + 1, sizeof(int64_t));
     int64_t *after_ticks = calloc(N_MEASURES + 1, sizeof(int64_t));
@@ -133,8 +249,10 @@ static bool doit(int mode)
 
     bool ret = measure(before_ticks, after_ticks, input_data, mode);
     differentiate(exec_times, before_ticks, after_ticks);
-    update_statistics(exec_times, classes);
-    ret &= report();
+    if (have_percentiles)
+        update_statistics(exec_times, classes);
+    else
+        prepare_percentiles(exec_times);
 
     free(before_ticks);
     free(after_ticks);
@@ -145,23 +263,167 @@ static bool doit(int mode)
     return ret;
 }
 
+static bool doit(int mode)
+{
+    bool ret = measure_batch(mode);
+    return report() && ret;
+}
+
+/* Choose the cores to measure on from those we may run on, wrapping around
+ * if fewer are available than asked for.  Return how many workers to use.
+ */
+static int pick_cpus(int *cpus, int wanted)
+{
+#if defined(__linux__)
+    cpu_set_t mask;
+    int avail[MAX_WORKERS], navail = 0;
+    if (!sched_getaffinity(0, sizeof(mask), &mask)) {
+        for (int c = 0; c < CPU_SETSIZE && navail < MAX_WORKERS; c++) {
+            if (CPU_ISSET(c, &mask))
+                avail[navail++] = c;
+        }
+    }
+    if (wanted <= 0)
+        wanted = navail;
+    if (wanted > MAX_WORKERS)
+        wanted = MAX_WORKERS;
+    for (int i = 0; i < wanted; i++)
+        cpus[i] = navail ? avail[i % navail] : -1;
+    return wanted > 0 ? wanted : 1;
+#else
+    if (wanted <= 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        wanted = n > 0 ? n : 1;
+    }
+    if (wanted > MAX_WORKERS)
+        wanted = MAX_WORKERS;
+    for (int i = 0; i < wanted; i++)
+        cpus[i] = -1;
+    return wanted;
+#endif
+}
+
+static void pin_to_cpu(int cpu)
+{
+#if defined(__linux__)
+    if (cpu < 0)
+        return;
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    CPU_SET(cpu, &mask);
+    sched_setaffinity(0, sizeof(mask), &mask);
+#else
+    (void) cpu;
+#endif
+}
+
+static bool read_full(int fd, void *buf, size_t len)
+{
+    char *p = buf;
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+/* Spread rounds batches over several processes, each pinned to its own core
+ * so that its measurements are not disturbed by migrations, and merge their
+ * statistics into t.  Processes rather than threads keep the allocation
+ * harness, which the queue code goes through, private to each worker.
+ */
+static bool doit_parallel(int mode, int rounds, int ncpus)
+{
+    int cpus[MAX_WORKERS], fds[MAX_WORKERS];
+    pid_t pids[MAX_WORKERS];
+    int workers = pick_cpus(cpus, ncpus);
+
+    /* Do not let the workers inherit and repeat buffered output */
+    fflush(stdout);
+
+    for (int k = 0; k < workers; k++) {
+        int pipefd[2];
+        pids[k] = -1;
+        fds[k] = -1;
+        if (pipe(pipefd))
+            continue;
+        /* Each worker inherits a differently keyed generator, so that they
+         * measure different inputs.
+         */
+        randombytes_reseed();
+        pids[k] = fork();
+        if (pids[k] == 0) {
+            close(pipefd[0]);
+            pin_to_cpu(cpus[k]);
+            for (int i = 0; i < N_TESTS; i++)
+                t_init(&t[i]);
+            bool ok = true;
+            for (int i = k; i < rounds; i += workers)
+                ok = measure_batch(mode) && ok;
+            ssize_t n = write(pipefd[1], t, N_TESTS * sizeof(*t));
+            n += write(pipefd[1], &ok, sizeof(ok));
+            _exit(n == N_TESTS * sizeof(*t) + sizeof(ok) ? 0 : 1);
+        }
+        close(pipefd[1]);
+        if (pids[k] < 0)
+            close(pipefd[0]);
+        else
+            fds[k] = pipefd[0];
+    }
+
+    bool ret = true;
+    for (int k = 0; k < workers; k++) {
+        t_context_t part[N_TESTS];
+        bool ok = false;
+        if (fds[k] < 0 || !read_full(fds[k], part, sizeof(part)) ||
+            !read_full(fds[k], &ok, sizeof(ok))) {
+            ret = false;
+        } else {
+            for (int i = 0; i < N_TESTS; i++)
+                t_merge(&t[i], &part[i]);
+        }
+        ret = ret && ok;
+        if (fds[k] >= 0)
+            close(fds[k]);
+        if (pids[k] > 0)
+            waitpid(pids[k], NULL, 0);
+    }
+
+    return report() && ret;
+}
+
 static void init_once(void)
 {
     init_dut();
-    t_init(t);
+    for (int i = 0; i < N_TESTS; i++)
+        t_init(&t[i]);
+    /* Without cropping, there are no thresholds to spend a batch on */
+    have_percentiles = !dudect_crop;
 }
 
 static bool test_const(char *text, int mode)
 {
     bool result = false;
-    t = malloc(sizeof(t_context_t));
+    t = malloc(N_TESTS * sizeof(t_context_t));
 
     for (int cnt = 0; cnt < TEST_TRIES; ++cnt) {
         printf("Testing %s...(%d/%d)\n\n", text, cnt, TEST_TRIES);
         init_once();
-        for (int i = 0; i < ENOUGH_MEASURE / (N_MEASURES - DROP_SIZE * 2) + 1;
-             ++i)
-            result = doit(mode);
+        /* With cropping, the first batch only sets the thresholds */
+        bool ok = !dudect_crop || measure_batch(mode);
+        int rounds = ENOUGH_MEASURE / (N_MEASURES - DROP_SIZE * 2) + 1;
+        if (dudect_cpus != 1) {
+            result = doit_parallel(mode, rounds, dudect_cpus);
+        } else {
+            for (int i = 0; i < rounds; ++i)
+                result = doit(mode);
+        }
+        result = ok && result;
         printf("\033[A\033[2K\033[A\033[2K");
         if (result)
             break;
@@ -170,6 +432,85 @@ static bool test_const(char *text, int mode)
     return result;
 }
 
+/* Lengths the complexity fit times an operation at, and the repetitions at
+ * each, of which the median is kept to shrug off interrupts.  The longest
+ * queue still fits in the L1 data cache, past which the latency of chasing
+ * list pointers rather than the algorithm would set the growth.
+ */
+#define FIT_SIZES 6
+#define FIT_MIN_SIZE 16
+#define FIT_REPS 31
+
+static double fit_model(complexity_t c, double n)
+{
+    switch (c) {
+    case O_1:
+        return 1;
+    case O_LOG_N:
+        return log2(n);
+    case O_N:
+        return n;
+    case O_N_LOG_N:
+    default:
+        return n * log2(n);
+    }
+}
+
+const char *complexity_name(complexity_t c)
+{
+    static const char *names[] = {
+        [O_1] = "O(1)",
+        [O_LOG_N] = "O(log n)",
+        [O_N] = "O(n)",
+        [O_N_LOG_N] = "O(n log n)",
+    };
+    return c < N_COMPLEXITIES ? names[c] : "?";
+}
+
+/* Fit cycles = coef * f(n) for every model f, much as Google Benchmark does,
+ * and keep the one with the smallest root mean square error.  Residuals are
+ * taken relative to the measured time so that the longest queues do not
+ * decide the fit alone.
+ */
+bool complexity_fit(int mode, complexity_t *big_o, double *rms)
+{
+    double n[FIT_SIZES], cycles[FIT_SIZES];
+    int64_t reps[FIT_REPS];
+
+    for (int k = 0; k < FIT_SIZES; k++) {
+        n[k] = (double) (FIT_MIN_SIZE << k);
+        for (int r = 0; r < FIT_REPS; r++) {
+            reps[r] = measure_once(mode, FIT_MIN_SIZE << k);
+            if (reps[r] < 0)
+                return false;
+        }
+        qsort(reps, FIT_REPS, sizeof(int64_t), cmp_int64);
+        cycles[k] = (double) (reps[FIT_REPS / 2] > 0 ? reps[FIT_REPS / 2] : 1);
+    }
+
+    *rms = INFINITY;
+    for (complexity_t c = 0; c < N_COMPLEXITIES; c++) {
+        /* Least squares of (cycles - coef * f) / cycles */
+        double sum_f = 0, sum_ff = 0;
+        for (int k = 0; k < FIT_SIZES; k++) {
+            double f = fit_model(c, n[k]) / cycles[k];
+            sum_f += f;
+            sum_ff += f * f;
+        }
+        double coef = sum_f / sum_ff, err = 0;
+        for (int k = 0; k < FIT_SIZES; k++) {
+            double d = 1 - coef * fit_model(c, n[k]) / cycles[k];
+            err += d * d;
+        }
+        err = sqrt(err / FIT_SIZES);
+        if (err < *rms) {
+            *rms = err;
+            *big_o = c;
+        }
+    }
+    return true;
+}
+
 #define DUT_FUNC_IMPL(op) \
     bool is_##op##_const(void) { return test_const(#op, DUT(op)); }
 
@@ -4,9 +4,36 @@
 #include <stdbool.h>
 #include "constant.h"
 
+/* Number of cores to spread measurements over: 1 measures in the calling
+ * process, 0 uses every core it may run on.
+ */
+extern int dudect_cpus;
+
+/* Whether the cropped and second-order t-tests take part in the verdict,
+ * rather than only the uncropped one.
+ */
+extern int dudect_crop;
+
 /* Interface to test if function is constant */
 #define _(x) bool is_##x##_const(void);
 DUT_FUNCS
 #undef _
 
+/* Asymptotic classes an operation's running time can be fitted to */
+typedef enum {
+    O_1,
+    O_LOG_N,
+    O_N,
+    O_N_LOG_N,
+    N_COMPLEXITIES,
+} complexity_t;
+
+const char *complexity_name(complexity_t c);
+
+/* Time operation mode on queues of growing length and find the class that
+ * fits best, with the fit error relative to the mean time in *rms.  Return
+ * false if the operation misbehaved.
+ */
+bool complexity_fit(int mode, complexity_t *big_o, double *rms);
+
 #endif
@@ -47,3 +47,18 @@ void t_init(t_context_t *ctx)
     }
     return;
 }
+
+void t_merge(t_context_t *dst, const t_context_t *src)
+{
+    /* Chan et al. pairwise update of mean and sum of squared deviations */
+    for (int class = 0; class < 2; class ++) {
+        double n = dst->n[class] + src->n[class];
+        if (src->n[class] == 0)
+            continue;
+        double delta = src->mean[class] - dst->mean[class];
+        dst->mean[class] += delta * src->n[class] / n;
+        dst->m2[class] += src->m2[class] +
+                          delta * delta * dst->n[class] * src->n[class] / n;
+        dst->n[class] = n;
+    }
+}
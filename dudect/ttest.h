@@ -13,4 +13,7 @@ void t_push(t_context_t *ctx, double x, uint8_t class);
 double t_compute(t_context_t *ctx);
 void t_init(t_context_t *ctx);
 
+/* Fold the statistics of src, gathered independently, into dst */
+void t_merge(t_context_t *dst, const t_context_t *src);
+
 #endif
@@ -1,7 +1,11 @@
 /* Test support code */
 
+#include <pthread.h>
+#include <sched.h>
 #include <setjmp.h>
 #include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -35,20 +39,42 @@
 typedef struct __block_element {
     struct __block_element *next, *prev;
     size_t payload_size;
-    size_t magic_header; /* Marker to see if block seems legitimate */
+    uint32_t magic_header; /* Marker to see if block seems legitimate */
+    uint32_t shard;        /* Index of the list the block is on */
     unsigned char payload[0];
     /* Also place magic number at tail of every block */
 } block_element_t;
 
-static block_element_t *allocated = NULL;
-static size_t allocated_count = 0;
+/* Allocated blocks are listed and counted in shards, one per thread, so that
+ * threads allocating at the same time do not contend.  A block stays on the
+ * shard of the thread that allocated it; a thread freeing it takes the lock
+ * of that shard, which is only ever contended by such frees.  Once its
+ * thread exits, a shard is handed to the next thread to start, blocks and
+ * all.
+ */
+#define MAX_SHARDS 256
+
+typedef struct {
+    atomic_flag lock;
+    block_element_t *allocated;
+    size_t allocated_count;
+    int next_free; /* Next shard without a thread, or -1 */
+} shard_t;
+
+static shard_t shards[MAX_SHARDS];
+static atomic_int n_shards = 1; /* Shard 0 is the first thread's */
+static int free_shards = -1;
+static pthread_mutex_t free_shards_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t shard_key;
+static pthread_once_t shard_key_once = PTHREAD_ONCE_INIT;
+static __thread int my_shard = -1;
 
 /* Percent probability of malloc failure */
 int fail_probability = 0;
 
 static bool cautious_mode = true;
 static bool noallocate_mode = false;
-static bool error_occurred = false;
+static atomic_bool error_occurred = false;
 static char *error_message = "";
 
 static int time_limit = 1;
@@ -67,6 +93,113 @@ static bool fail_allocation()
     return (weight < 0.01 * fail_probability);
 }
 
+/* Sections of the calling thread that must not be left by longjmp: holding
+ * a shard lock, or inside the C library's malloc or free.  An exception
+ * raised meanwhile, as by the time limit alarm, is only recorded, and raised
+ * by raise_deferred() once the harness function is done with them.
+ */
+static __thread volatile sig_atomic_t critical;
+static __thread char *volatile deferred_message;
+
+static inline void critical_enter(void)
+{
+    critical++;
+    atomic_signal_fence(memory_order_seq_cst);
+}
+
+static inline void critical_leave(void)
+{
+    atomic_signal_fence(memory_order_seq_cst);
+    critical--;
+}
+
+static void shard_lock(shard_t *shard)
+{
+    critical_enter();
+    /* The holder may be waiting for the core, so let it run */
+    while (atomic_flag_test_and_set_explicit(&shard->lock,
+                                             memory_order_acquire))
+        sched_yield();
+}
+
+static void shard_unlock(shard_t *shard)
+{
+    atomic_flag_clear_explicit(&shard->lock, memory_order_release);
+    critical_leave();
+}
+
+static void raise_deferred(void)
+{
+    char *msg = deferred_message;
+    if (msg) {
+        deferred_message = NULL;
+        trigger_exception(msg);
+    }
+}
+
+static void shard_release(void *arg)
+{
+    int id = (int) (intptr_t) arg - 1;
+    pthread_mutex_lock(&free_shards_lock);
+    shards[id].next_free = free_shards;
+    free_shards = id;
+    pthread_mutex_unlock(&free_shards_lock);
+}
+
+static void shard_key_create(void)
+{
+    pthread_key_create(&shard_key, shard_release);
+}
+
+/* Index of the shard of the calling thread, set up on its first call, or -1
+ * if there are too many threads.
+ */
+static int get_shard(void)
+{
+    if (my_shard >= 0)
+        return my_shard;
+
+    /* The first thread, normally qtest's only one, keeps shard 0 for good */
+    static atomic_bool first_claimed = false;
+    if (!atomic_exchange(&first_claimed, true))
+        return my_shard = 0;
+
+    pthread_once(&shard_key_once, shard_key_create);
+    pthread_mutex_lock(&free_shards_lock);
+    int id = free_shards;
+    if (id >= 0)
+        free_shards = shards[id].next_free;
+    pthread_mutex_unlock(&free_shards_lock);
+
+    if (id < 0) {
+        id = atomic_fetch_add(&n_shards, 1);
+        if (id >= MAX_SHARDS) {
+            report_event(MSG_FATAL, "More than %d threads using the harness",
+                         MAX_SHARDS);
+            return -1;
+        }
+    }
+    /* Non-NULL, so that the destructor runs */
+    pthread_setspecific(shard_key, (void *) (intptr_t) (id + 1));
+    return my_shard = id;
+}
+
+/* Whether b is on the list of any shard */
+static bool is_allocated(block_element_t *b)
+{
+    bool found = false;
+    int n = atomic_load(&n_shards);
+    for (int id = 0; id < n && id < MAX_SHARDS && !found; id++) {
+        shard_t *shard = &shards[id];
+        shard_lock(shard);
+        for (block_element_t *ab = shard->allocated; ab && !found;
+             ab = ab->next)
+            found = ab == b;
+        shard_unlock(shard);
+    }
+    return found;
+}
+
 /* Find header of block, given its payload.
  * Signal error if doesn't seem like legitimate block
  */
@@ -81,13 +214,7 @@ static block_element_t *find_header(void *p)
         (block_element_t *) ((size_t) p - sizeof(block_element_t));
     if (cautious_mode) {
         /* Make sure this is really an allocated block */
-        block_element_t *ab = allocated;
-        bool found = false;
-        while (ab && !found) {
-            found = ab == b;
-            ab = ab->next;
-        }
-        if (!found) {
+        if (!is_allocated(b)) {
             report_event(MSG_ERROR,
                          "Attempted to free unallocated block.  Address = %p",
                          p);
@@ -129,9 +256,12 @@ void *test_malloc(size_t size)
         return NULL;
     }
 
+    int id = get_shard();
+    critical_enter();
     block_element_t *new_block =
         malloc(size + sizeof(block_element_t) + sizeof(size_t));
-    if (!new_block) {
+    critical_leave();
+    if (!new_block || id < 0) {
         report_event(MSG_FATAL, "Couldn't allocate any more memory");
         error_occurred = true;
     }
@@ -144,15 +274,21 @@ void *test_malloc(size_t size)
     void *p = (void *) &new_block->payload;
     memset(p, FILLCHAR, size);
     // cppcheck-suppress nullPointerRedundantCheck
-    new_block->next = allocated;
+    new_block->shard = id;
     // cppcheck-suppress nullPointerRedundantCheck
     new_block->prev = NULL;
 
-    if (allocated)
-        allocated->prev = new_block;
-    allocated = new_block;
-    allocated_count++;
-
+    shard_t *shard = &shards[id];
+    shard_lock(shard);
+    new_block->next = shard->allocated;
+    if (shard->allocated)
+        shard->allocated->prev = new_block;
+    shard->allocated = new_block;
+    shard->allocated_count++;
+    shard_unlock(shard);
+
+    STATS_COUNT(allocs, 1);
+    raise_deferred();
     return p;
 }
 
@@ -179,6 +315,11 @@ void test_free(void *p)
         return;
 
     block_element_t *b = find_header(p);
+    /* Not a block of ours, so its shard and footer cannot be trusted */
+    if (b->magic_header != MAGICHEADER) {
+        raise_deferred();
+        return;
+    }
     size_t footer = *find_footer(b);
     if (footer != MAGICFOOTER) {
         report_event(MSG_ERROR,
@@ -192,17 +333,24 @@ void test_free(void *p)
     memset(p, FILLCHAR, b->payload_size);
 
     /* Unlink from list */
+    shard_t *shard = &shards[b->shard];
+    shard_lock(shard);
     block_element_t *bn = b->next;
     block_element_t *bp = b->prev;
     if (bp)
         bp->next = bn;
     else
-        allocated = bn;
+        shard->allocated = bn;
     if (bn)
         bn->prev = bp;
+    shard->allocated_count--;
+    shard_unlock(shard);
 
+    STATS_COUNT(frees, 1);
+    critical_enter();
     free(b);
-    allocated_count--;
+    critical_leave();
+    raise_deferred();
 }
 
 // cppcheck-suppress unusedFunction
@@ -216,9 +364,25 @@ char *test_strdup(const char *s)
     return memcpy(new, s, len);
 }
 
+#ifdef ENABLE_STATS
+int test_strcmp(const char *s1, const char *s2)
+{
+    STATS_COUNT(cmps, 1);
+    return strcmp(s1, s2);
+}
+#endif
+
 size_t allocation_check()
 {
-    return allocated_count;
+    size_t count = 0;
+    int n = atomic_load(&n_shards);
+    for (int id = 0; id < n && id < MAX_SHARDS; id++) {
+        shard_lock(&shards[id]);
+        count += shards[id].allocated_count;
+        shard_unlock(&shards[id]);
+    }
+    raise_deferred();
+    return count;
 }
 
 /* Implementation of functions for testing */
@@ -242,9 +406,7 @@ void set_noallocate_mode(bool noallocate)
 /* Return whether any errors have occurred since last time set error limit */
 bool error_check()
 {
-    bool e = error_occurred;
-    error_occurred = false;
-    return e;
+    return atomic_exchange(&error_occurred, false);
 }
 
 /* Prepare for a risky operation using setjmp.
@@ -253,8 +415,9 @@ bool error_check()
 bool exception_setup(bool limit_time)
 {
     if (sigsetjmp(env, 1)) {
-        /* Got here from longjmp */
+        /* Got here from longjmp, out of whatever operation was counted */
         jmp_ready = false;
+        STATS_ABANDON();
         if (time_limited) {
             alarm(0);
             time_limited = false;
@@ -290,6 +453,10 @@ void exception_cancel()
 /* Use longjmp to return to most recent exception setup */
 void trigger_exception(char *msg)
 {
+    if (critical) {
+        deferred_message = msg;
+        return;
+    }
     error_occurred = true;
     error_message = msg;
     if (jmp_ready)
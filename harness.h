@@ -5,6 +5,8 @@
 #include <stdarg.h>
 #include <stdbool.h>
 
+#include "stats.h"
+
 /* This test harness enables us to do stringent testing of code.
  * It overloads the library versions of malloc and free with ones that
  * allow checking for common allocation errors.
@@ -14,6 +16,10 @@ void *test_malloc(size_t size);
 void *test_calloc(size_t nmemb, size_t size);
 void test_free(void *p);
 char *test_strdup(const char *s);
+#ifdef ENABLE_STATS
+/* strcmp, counted in the stats of the calling operation */
+int test_strcmp(const char *s1, const char *s2);
+#endif
 /* FIXME: provide test_realloc as well */
 
 #ifdef INTERNAL
@@ -61,6 +67,11 @@ void trigger_exception(char *msg);
 #undef strdup
 #define strdup test_strdup
 
+#ifdef ENABLE_STATS
+#undef strcmp
+#define strcmp test_strcmp
+#endif
+
 #endif
 
 #endif /* LAB0_HARNESS_H */
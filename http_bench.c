@@ -0,0 +1,258 @@
+/* Correctness check and micro-benchmark of http_parse_request() against the
+ * sscanf-based parser it replaced, over requests recorded from the clients
+ * commonly pointed at qtest's web server.  A file holding more recorded
+ * requests, back to back as they came off the socket, may be given as the
+ * only argument.
+ */
+
+#define _GNU_SOURCE /* memmem, strcasestr */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include "http_parser.h"
+
+#define MAXLINE 1024
+#define MAX_REQUEST (64 * 1024)
+#define BENCH_ROUNDS 20000
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1.0E-9 * ts.tv_nsec;
+}
+
+/* Requests as sent by curl, Python's http.client, a browser and a pipelining
+ * client, each with the command it must decode to.
+ */
+static const struct {
+    const char *raw;
+    const char *cmd;
+} recorded[] = {
+    {"GET /it/abc HTTP/1.1\r\nHost: localhost:9999\r\n"
+     "User-Agent: curl/7.88.1\r\nAccept: */*\r\n\r\n",
+     "it abc"},
+    {"GET /size HTTP/1.1\r\nHost: 127.0.0.1:9999\r\n"
+     "Accept-Encoding: identity\r\n\r\n",
+     "size"},
+    {"GET /ih/hello%20world/3 HTTP/1.1\r\nHost: localhost:9999\r\n"
+     "Connection: keep-alive\r\nsec-ch-ua: \"Chromium\";v=\"118\"\r\n"
+     "sec-ch-ua-mobile: ?0\r\nsec-ch-ua-platform: \"Linux\"\r\n"
+     "Upgrade-Insecure-Requests: 1\r\nUser-Agent: Mozilla/5.0 (X11; Linux "
+     "x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/118.0.0.0 "
+     "Safari/537.36\r\nAccept: text/html,application/xhtml+xml,application/"
+     "xml;q=0.9,image/avif,image/webp,*/*;q=0.8\r\nSec-Fetch-Site: none\r\n"
+     "Sec-Fetch-Mode: navigate\r\nSec-Fetch-User: ?1\r\nSec-Fetch-Dest: "
+     "document\r\nAccept-Encoding: gzip, deflate, br\r\nAccept-Language: "
+     "en-US,en;q=0.9\r\n\r\n",
+     "ih hello world 3"},
+    {"GET /sort?t=1 HTTP/1.0\r\n\r\n", "sort"},
+    {"GET / HTTP/1.1\r\nConnection: close\r\n\r\n", "."},
+    /* Last, as the reference parser looks past it for a "\n\r\n" */
+    {"GET /rh HTTP/1.1\n\n", "rh"},
+};
+
+#define N_RECORDED (sizeof(recorded) / sizeof(recorded[0]))
+
+/* The parser previously in web.c, for reference */
+static void url_decode(char *src, char *dest, int max)
+{
+    char *p = src;
+    char code[3] = {0};
+    while (*p && --max) {
+        if (*p == '%') {
+            memcpy(code, ++p, 2);
+            *dest++ = (char) strtoul(code, NULL, 16);
+            p += 2;
+        } else {
+            *dest++ = *p++;
+        }
+    }
+    *dest = '\0';
+}
+
+static ssize_t parse_request_ref(char *buf, size_t len, char *filename)
+{
+    char *end = memmem(buf, len, "\n\r\n", 3);
+    size_t header_len = end ? end - buf + 3 : 0;
+    if (!end) {
+        end = memmem(buf, len, "\n\n", 2);
+        if (!end)
+            return len > MAX_REQUEST ? -1 : 0;
+        header_len = end - buf + 2;
+    }
+
+    char line[MAXLINE], method[MAXLINE], uri[MAXLINE], version[MAXLINE];
+    char *p = buf, *eol = memchr(p, '\n', header_len);
+    size_t n = eol - p < MAXLINE - 1 ? eol - p : MAXLINE - 1;
+    memcpy(line, p, n);
+    line[n] = '\0';
+    version[0] = '\0';
+    if (sscanf(line, "%1023s %1023s %1023s", method, uri, version) < 2)
+        return -1;
+
+    bool keep_alive = !strncmp(version, "HTTP/1.1", 8);
+    size_t content_length = 0;
+    for (p = eol + 1; p < buf + header_len; p = eol + 1) {
+        eol = memchr(p, '\n', buf + header_len - p);
+        if (!strncasecmp(p, "Connection:", 11)) {
+            n = eol - p < MAXLINE - 1 ? eol - p : MAXLINE - 1;
+            memcpy(line, p, n);
+            line[n] = '\0';
+            if (strcasestr(line, "close"))
+                keep_alive = false;
+            else if (strcasestr(line, "keep-alive"))
+                keep_alive = true;
+        } else if (!strncasecmp(p, "Content-Length:", 15)) {
+            content_length = strtoul(p + 15, NULL, 10);
+        }
+    }
+    (void) keep_alive;
+    if (content_length > MAX_REQUEST)
+        return -1;
+    if (len < header_len + content_length)
+        return 0;
+
+    char *name = uri;
+    if (uri[0] == '/') {
+        name = uri + 1;
+        int length = strlen(name);
+        if (length == 0) {
+            name = ".";
+        } else {
+            for (int i = 0; i < length; ++i) {
+                if (name[i] == '?') {
+                    name[i] = '\0';
+                    break;
+                }
+            }
+        }
+    }
+    url_decode(name, filename, MAXLINE);
+    for (p = filename; *p; p++) {
+        if (*p == '/')
+            *p = ' ';
+    }
+    return header_len + content_length;
+}
+
+static int check(void)
+{
+    int errors = 0;
+    char buf[MAXLINE * 2];
+    for (size_t i = 0; i < N_RECORDED; i++) {
+        size_t len = strlen(recorded[i].raw);
+        http_request_t req;
+
+        /* Every prefix is incomplete, and left as it was */
+        for (size_t k = 0; k < len; k++) {
+            memcpy(buf, recorded[i].raw, len);
+            if (http_parse_request(buf, k, MAX_REQUEST, &req) != 0 ||
+                memcmp(buf, recorded[i].raw, len)) {
+                printf("Request %zu: wrong result for %zu of %zu bytes\n", i,
+                       k, len);
+                errors++;
+                break;
+            }
+        }
+
+        memcpy(buf, recorded[i].raw, len);
+        ssize_t n = http_parse_request(buf, len, MAX_REQUEST, &req);
+        if (n != (ssize_t) len || strcmp(req.cmd, recorded[i].cmd)) {
+            printf("Request %zu: parsed %zd of %zu bytes as \"%s\"\n", i, n,
+                   len, n > 0 ? req.cmd : "");
+            errors++;
+        }
+    }
+    return errors;
+}
+
+/* Parse every request in a stream of size bytes, the way a connection would
+ * see it arrive in a single read.  Return the number of requests.
+ */
+static size_t parse_stream(char *buf, size_t size, bool ref)
+{
+    size_t used = 0, count = 0;
+    while (used < size) {
+        ssize_t n;
+        if (ref) {
+            char filename[MAXLINE];
+            n = parse_request_ref(buf + used, size - used, filename);
+        } else {
+            http_request_t req;
+            n = http_parse_request(buf + used, size - used, MAX_REQUEST, &req);
+        }
+        if (n <= 0)
+            break;
+        used += n;
+        count++;
+    }
+    return count;
+}
+
+static double bench(const char *stream, char *buf, size_t size, bool ref,
+                    size_t *count)
+{
+    double start = now();
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+        memcpy(buf, stream, size);
+        *count = parse_stream(buf, size, ref);
+    }
+    return (now() - start) * 1.0E9 / (BENCH_ROUNDS * (*count ? *count : 1));
+}
+
+int main(int argc, char *argv[])
+{
+    int errors = check();
+    printf("http_parse_request: %d errors on recorded requests\n", errors);
+
+    char *stream;
+    size_t size = 0;
+    if (argc > 1) {
+        FILE *f = fopen(argv[1], "rb");
+        if (!f) {
+            perror(argv[1]);
+            return EXIT_FAILURE;
+        }
+        fseek(f, 0, SEEK_END);
+        size = ftell(f);
+        rewind(f);
+        stream = malloc(size + 1);
+        if (!stream || fread(stream, 1, size, f) != size) {
+            fclose(f);
+            return EXIT_FAILURE;
+        }
+        fclose(f);
+    } else {
+        for (size_t i = 0; i < N_RECORDED; i++)
+            size += strlen(recorded[i].raw);
+        stream = malloc(size + 1);
+        if (!stream)
+            return EXIT_FAILURE;
+        size = 0;
+        for (size_t i = 0; i < N_RECORDED; i++) {
+            strcpy(stream + size, recorded[i].raw);
+            size += strlen(recorded[i].raw);
+        }
+    }
+
+    char *buf = malloc(size + 1);
+    if (!buf)
+        return EXIT_FAILURE;
+    size_t count_ref, count;
+    double ref = bench(stream, buf, size, true, &count_ref);
+    double fast = bench(stream, buf, size, false, &count);
+    printf("%zu requests: reference %.1f ns/request, single pass %.1f "
+           "ns/request\n",
+           count, ref, fast);
+    if (count != count_ref)
+        printf("(the reference parser found %zu requests)\n", count_ref);
+
+    free(buf);
+    free(stream);
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
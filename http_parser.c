@@ -0,0 +1,154 @@
+#include <stdint.h>
+#include <string.h>
+#include <strings.h> /* strncasecmp */
+
+#include "http_parser.h"
+
+static inline int lower(int c)
+{
+    return c | 0x20;
+}
+
+static inline int hex_value(int c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    c = lower(c);
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
+}
+
+/* Header line [p, eol) starts with name, which is in lower case and includes
+ * the colon.  Return the start of the value, or NULL.
+ */
+static const char *header_value(const char *p, const char *eol,
+                                const char *name, size_t n)
+{
+    if ((size_t) (eol - p) < n || strncasecmp(p, name, n))
+        return NULL;
+    for (p += n; p < eol && (*p == ' ' || *p == '\t');)
+        p++;
+    return p;
+}
+
+/* Whether [p, end) contains tok, ignoring case */
+static bool has_token(const char *p, const char *end, const char *tok,
+                      size_t n)
+{
+    for (; (size_t) (end - p) >= n; p++) {
+        if (lower(*p) == tok[0] && !strncasecmp(p, tok, n))
+            return true;
+    }
+    return false;
+}
+
+/* Decode the URI [src, end) into the command line at src: drop the leading
+ * '/' and any query string, undo %XX escapes, and turn the remaining '/'
+ * into ' ' so that "/it/a" becomes "it a".  *end may be overwritten by the
+ * terminating NUL, which is fine as it is the separator after the URI.
+ */
+static char *decode_cmd(char *src, char *end)
+{
+    bool slash = src < end && *src == '/';
+    if (slash)
+        src++;
+    if (slash && (src == end || *src == '?')) {
+        /* Historically an empty path names the current directory */
+        src[-1] = '.';
+        src[0] = '\0';
+        return src - 1;
+    }
+
+    char *cmd = src, *dst = src;
+    while (src < end && *src != '?') {
+        char c = *src++;
+        if (c == '%' && end - src >= 2) {
+            int hi = hex_value(src[0]), lo = hex_value(src[1]);
+            if (hi >= 0 && lo >= 0) {
+                c = (char) (hi << 4 | lo);
+                src += 2;
+            }
+        }
+        *dst++ = c == '/' ? ' ' : c;
+    }
+    *dst = '\0';
+    return cmd;
+}
+
+ssize_t http_parse_request(char *buf, size_t len, size_t max,
+                           http_request_t *req)
+{
+    char *p = buf, *end = buf + (len < max ? len : max);
+
+    /* Tolerate empty lines left over from a previous request */
+    while (p < end && (*p == '\r' || *p == '\n'))
+        p++;
+
+    char *eol = memchr(p, '\n', end - p);
+    if (!eol)
+        return len < max ? 0 : -1;
+
+    /* Request line: METHOD SP URI [SP VERSION] */
+    char *line_end = eol > p && eol[-1] == '\r' ? eol - 1 : eol;
+    char *uri = memchr(p, ' ', line_end - p);
+    if (!uri || uri == p)
+        return -1;
+    req->batch = uri - p == 4 && !memcmp(p, "POST", 4);
+    uri++;
+    char *uri_end = memchr(uri, ' ', line_end - uri);
+    if (!uri_end)
+        uri_end = line_end;
+    if (uri_end == uri)
+        return -1;
+    const char *version = uri_end < line_end ? uri_end + 1 : line_end;
+    req->http11 = line_end - version >= 8 && !memcmp(version, "HTTP/1.1", 8);
+    req->keep_alive = req->http11;
+    req->expect = false;
+    req->content_length = 0;
+
+    /* Header lines until an empty one */
+    for (p = eol + 1;; p = eol + 1) {
+        eol = memchr(p, '\n', end - p);
+        if (!eol)
+            return len < max ? 0 : -1;
+        if (eol == p || (eol == p + 1 && *p == '\r'))
+            break;
+
+        const char *v;
+        switch (lower(*p)) {
+        case 'c':
+            if ((v = header_value(p, eol, "connection:", 11))) {
+                if (has_token(v, eol, "close", 5))
+                    req->keep_alive = false;
+                else if (has_token(v, eol, "keep-alive", 10))
+                    req->keep_alive = true;
+            } else if ((v = header_value(p, eol, "content-length:", 15))) {
+                size_t n = 0;
+                for (; v < eol && *v >= '0' && *v <= '9'; v++) {
+                    if (n > (SIZE_MAX - 9) / 10)
+                        return -1;
+                    n = n * 10 + (*v - '0');
+                }
+                req->content_length = n;
+            }
+            break;
+        case 'e':
+            if ((v = header_value(p, eol, "expect:", 7)))
+                req->expect = has_token(v, eol, "100-continue", 12);
+            break;
+        }
+    }
+
+    size_t header_len = eol + 1 - buf;
+    if (!req->batch) {
+        /* The body of other requests is not used, but has to be skipped */
+        if (req->content_length > max)
+            return -1;
+        if (len < header_len + req->content_length)
+            return 0;
+    }
+
+    req->cmd = decode_cmd(uri, uri_end);
+    return header_len + (req->batch ? 0 : req->content_length);
+}
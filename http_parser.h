@@ -0,0 +1,38 @@
+#ifndef LAB0_HTTP_PARSER_H
+#define LAB0_HTTP_PARSER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/* What the web server needs to know about one request.
+ * @cmd: command line decoded from the request URI.  It points into the
+ *       buffer that was parsed, so it is only valid as long as that is.
+ * @keep_alive: connection stays open after the response
+ * @http11: client speaks HTTP/1.1, e.g. understands chunked encoding
+ * @batch: POST request whose body holds command lines
+ * @expect: client waits for "100 Continue" before sending the body
+ * @content_length: size of the body
+ */
+typedef struct {
+    char *cmd;
+    bool keep_alive;
+    bool http11;
+    bool batch;
+    bool expect;
+    size_t content_length;
+} http_request_t;
+
+/* Parse the request at the start of the len bytes at buf, in one pass and
+ * without copying.  Return the length of the request, 0 if it is not
+ * complete yet, or -1 if it is malformed or larger than max bytes.
+ *
+ * Once the request is complete, the command is decoded in place inside the
+ * request line.  Before that, buf is left untouched, so parsing can simply be
+ * retried when more data arrives.  The body of a batch is consumed by the
+ * caller as it arrives, so only the header counts toward its length.
+ */
+ssize_t http_parse_request(char *buf, size_t len, size_t max,
+                           http_request_t *req);
+
+#endif /* LAB0_HTTP_PARSER_H */
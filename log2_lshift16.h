@@ -5,13 +5,16 @@
  * calculation.
  */
 
+#ifndef LAB0_LOG2_LSHIFT16_H
+#define LAB0_LOG2_LSHIFT16_H
+
 #include <stdint.h>
 
 #define LOG2_ARG_SHIFT (1 << 16)
 #define LOG2_RET_SHIFT (1 << 3)
 
 /* store precalculated function (log2(arg << 24)) << 3 */
-static inline int log2_lshift16(uint64_t lshift16)
+static inline int log2_lshift16_ref(uint64_t lshift16)
 {
     if (lshift16 < 558) {
         if (lshift16 < 54) {
@@ -280,3 +283,71 @@ static inline int log2_lshift16(uint64_t lshift16)
     }
     return 0;
 }
+
+/* Table-driven, branch-free equivalent of log2_lshift16_ref().
+ *
+ * The reference function is a step function with LOG2_N_STEPS steps.  Its
+ * argument is split into cells by normalizing it with __builtin_clzll and
+ * keeping LOG2_CELL_BITS bits of mantissa below the leading one (arguments
+ * below 1 << LOG2_CELL_BITS get one cell each).  Cells are narrow enough to
+ * contain at most one step boundary, so log2_cell[] gives the first step
+ * overlapping a cell and a single comparison against that step's upper bound
+ * selects between it and the next one.
+ *
+ * The tables below, from the LOG2_CELL_BITS line on, are the output of
+ * "./log2_test --gen", which derives them from log2_lshift16_ref(); run it
+ * again after changing either.  "make check-log2" checks the two against each
+ * other exhaustively.
+ */
+#define LOG2_CELL_BITS 4
+#define LOG2_N_STEPS 111
+#define LOG2_N_CELLS (((17 - LOG2_CELL_BITS) << LOG2_CELL_BITS) + 1)
+
+/* Return value of each step */
+static const int16_t log2_step_value[LOG2_N_STEPS] = {
+    -136, -123, -117, -113, -110, -108, -106, -104, -103, -102, -100, -99, -98,
+    -97, -96, -95, -94, -93, -92, -91, -90, -89, -88, -87, -86, -85, -84, -83,
+    -82, -81, -80, -79, -78, -77, -76, -75, -74, -73, -72, -71, -70, -69, -68,
+    -67, -66, -65, -64, -63, -62, -61, -60, -59, -58, -57, -56, -55, -54, -53,
+    -52, -51, -50, -49, -48, -47, -46, -45, -44, -43, -42, -41, -40, -39, -38,
+    -37, -36, -35, -34, -33, -32, -31, -30, -29, -28, -27, -26, -25, -24, -23,
+    -22, -21, -20, -19, -18, -17, -16, -15, -14, -13, -12, -11, -10, -9, -8, -7,
+    -6, -5, -4, -3, -2, -1, 0};
+
+/* Exclusive upper bound of the argument for each step */
+static const uint32_t log2_step_bound[LOG2_N_STEPS] = {
+    1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 15, 16, 17, 19, 21, 23, 25, 27,
+    29, 32, 35, 38, 41, 45, 49, 54, 59, 64, 70, 76, 83, 91, 99, 108, 117, 128,
+    140, 152, 166, 181, 197, 215, 235, 256, 279, 304, 332, 362, 395, 431, 470,
+    512, 558, 609, 664, 724, 790, 861, 939, 1024, 1117, 1218, 1328, 1448, 1579,
+    1722, 1878, 2048, 2233, 2435, 2656, 2896, 3158, 3444, 3756, 4096, 4467,
+    4871, 5312, 5793, 6317, 6889, 7512, 8192, 8933, 9742, 10624, 11585, 12634,
+    13777, 15024, 16384, 17867, 19484, 21247, 23170, 25268, 27554, 30048, 32768,
+    35734, 38968, 42495, 46341, 50535, 55109, 60097, UINT32_MAX};
+
+/* First step overlapping each cell */
+static const uint8_t log2_cell[LOG2_N_CELLS] = {
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 13, 14, 15, 16, 16, 17, 17,
+    18, 18, 19, 19, 20, 20, 21, 21, 22, 22, 22, 23, 23, 24, 25, 25, 26, 26, 27,
+    27, 28, 28, 29, 29, 29, 30, 30, 31, 31, 32, 33, 33, 34, 34, 35, 35, 36, 36,
+    37, 37, 37, 38, 38, 39, 39, 40, 41, 41, 42, 42, 43, 43, 44, 44, 45, 45, 45,
+    46, 46, 47, 47, 48, 49, 49, 50, 50, 51, 51, 52, 52, 53, 53, 53, 54, 54, 55,
+    55, 56, 56, 57, 58, 58, 59, 59, 60, 60, 61, 61, 61, 62, 62, 63, 63, 64, 64,
+    65, 66, 66, 67, 67, 68, 68, 69, 69, 69, 70, 70, 71, 71, 72, 72, 73, 74, 74,
+    75, 75, 76, 76, 77, 77, 77, 78, 78, 79, 79, 80, 80, 81, 82, 82, 83, 83, 84,
+    84, 85, 85, 85, 86, 86, 87, 87, 88, 88, 89, 90, 90, 91, 91, 92, 92, 93, 93,
+    93, 94, 94, 95, 95, 96, 96, 97, 98, 98, 99, 99, 100, 100, 101, 101, 101,
+    102, 102, 103, 103, 104, 104, 105, 106, 106, 107, 107, 108, 108, 109, 109,
+    109, 110, 110, 110};
+
+/* Defined for lshift16 in [0, LOG2_ARG_SHIFT]; larger arguments are clamped */
+static inline int log2_lshift16(uint64_t lshift16)
+{
+    uint64_t x = lshift16 > LOG2_ARG_SHIFT ? LOG2_ARG_SHIFT : lshift16;
+    int shift = 63 - __builtin_clzll(x | 1) - LOG2_CELL_BITS;
+    shift &= ~(shift >> 31); /* max(shift, 0) */
+    uint32_t i = log2_cell[(shift << LOG2_CELL_BITS) + (x >> shift)];
+    return log2_step_value[i + (x >= log2_step_bound[i])];
+}
+
+#endif /* LAB0_LOG2_LSHIFT16_H */
@@ -0,0 +1,148 @@
+/* Exhaustive equivalence check and micro-benchmark of the table-driven
+ * log2_lshift16() against the comparison tree log2_lshift16_ref().
+ *
+ * With --gen, it prints the tables of log2_lshift16() instead, derived from
+ * log2_lshift16_ref() for the LOG2_CELL_BITS in log2_lshift16.h, to replace
+ * the ones there after either of those changes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "log2_lshift16.h"
+
+#define BENCH_SIZE (1 << 16)
+#define BENCH_ROUNDS 512
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1.0E-9 * ts.tv_nsec;
+}
+
+static int check(void)
+{
+    int errors = 0;
+    /* Whole input domain, plus a margin above it where both return 0 */
+    for (uint64_t x = 0; x <= (uint64_t) LOG2_ARG_SHIFT << 4; x++) {
+        if (log2_lshift16(x) != log2_lshift16_ref(x)) {
+            if (errors++ < 10)
+                printf("Mismatch at %lu: %d != %d\n", (unsigned long) x,
+                       log2_lshift16(x), log2_lshift16_ref(x));
+        }
+    }
+    if (log2_lshift16(UINT64_MAX) != log2_lshift16_ref(UINT64_MAX))
+        errors++;
+    return errors;
+}
+
+/* Print an array definition, filling lines up to 80 columns */
+static void print_table(const char *decl, const int64_t *a, int n)
+{
+    printf("%s = {\n   ", decl);
+    int col = 3;
+    for (int i = 0; i < n; i++) {
+        char item[16];
+        if (a[i] == UINT32_MAX)
+            strcpy(item, "UINT32_MAX");
+        else
+            snprintf(item, sizeof(item), "%ld", (long) a[i]);
+        /* The element, its separator and, after the last one, "};" */
+        int len = 1 + strlen(item) + (i == n - 1 ? 2 : 1);
+        if (col + len > 80) {
+            printf("\n   ");
+            col = 3;
+        }
+        printf(" %s%s", item, i == n - 1 ? "};\n" : ",");
+        col += len;
+    }
+}
+
+static int gen(void)
+{
+    /* Steps of the reference function over its whole input domain */
+    static int64_t value[LOG2_ARG_SHIFT + 1], bound[LOG2_ARG_SHIFT + 1];
+    int steps = 0;
+    value[0] = log2_lshift16_ref(0);
+    for (uint64_t x = 1; x <= LOG2_ARG_SHIFT; x++) {
+        int v = log2_lshift16_ref(x);
+        if (v != value[steps]) {
+            bound[steps++] = x;
+            value[steps] = v;
+        }
+    }
+    /* Larger arguments are clamped into the last step */
+    bound[steps++] = UINT32_MAX;
+
+    /* First step overlapping each cell, that of the least argument in it */
+    int64_t cell[LOG2_N_CELLS];
+    for (int c = 0; c < LOG2_N_CELLS; c++) {
+        int shift = (c >> LOG2_CELL_BITS) - 1;
+        uint64_t x = c;
+        if (shift > 0)
+            x = (uint64_t) (c - (shift << LOG2_CELL_BITS)) << shift;
+        int i = 0;
+        while (x >= (uint64_t) bound[i])
+            i++;
+        cell[c] = i;
+    }
+
+    printf("#define LOG2_CELL_BITS %d\n", LOG2_CELL_BITS);
+    printf("#define LOG2_N_STEPS %d\n", steps);
+    printf("#define LOG2_N_CELLS (((17 - LOG2_CELL_BITS) << LOG2_CELL_BITS) "
+           "+ 1)\n\n");
+    printf("/* Return value of each step */\n");
+    print_table("static const int16_t log2_step_value[LOG2_N_STEPS]", value,
+                steps);
+    printf("\n/* Exclusive upper bound of the argument for each step */\n");
+    print_table("static const uint32_t log2_step_bound[LOG2_N_STEPS]", bound,
+                steps);
+    printf("\n/* First step overlapping each cell */\n");
+    print_table("static const uint8_t log2_cell[LOG2_N_CELLS]", cell,
+                LOG2_N_CELLS);
+    return EXIT_SUCCESS;
+}
+
+static uint32_t input[BENCH_SIZE];
+
+#define BENCH(fn)                                              \
+    ({                                                         \
+        int sum = 0;                                           \
+        double start = now();                                  \
+        for (int r = 0; r < BENCH_ROUNDS; r++) {               \
+            for (int i = 0; i < BENCH_SIZE; i++)               \
+                sum += fn(input[i]);                           \
+            __asm__ volatile("" : "+r"(sum));                  \
+        }                                                      \
+        (now() - start) * 1.0E9 / (BENCH_ROUNDS * BENCH_SIZE); \
+    })
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1 && !strcmp(argv[1], "--gen"))
+        return gen();
+
+    int errors = check();
+    printf("log2_lshift16: %d mismatches against reference\n", errors);
+
+    /* Arguments as fed by the entropy computation: a bucket count scaled by
+     * LOG2_ARG_SHIFT over the string length.
+     */
+    uint32_t seed = 1;
+    for (int i = 0; i < BENCH_SIZE; i++) {
+        seed = seed * 1103515245 + 12345;
+        uint32_t len = 1 + (seed >> 8) % 1024;
+        seed = seed * 1103515245 + 12345;
+        uint32_t cnt = 1 + (seed >> 8) % len;
+        input[i] = cnt * (LOG2_ARG_SHIFT / len);
+    }
+
+    double ref = BENCH(log2_lshift16_ref);
+    double fast = BENCH(log2_lshift16);
+    printf("reference: %.2f ns/call, table: %.2f ns/call\n", ref, fast);
+
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -2,13 +2,18 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
 #include <getopt.h>
+#include <limits.h>
+#include <math.h>
 #include <signal.h>
 #include <spawn.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h> /* strcasecmp */
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
 #include <unistd.h>
@@ -19,12 +24,14 @@
 #include <time.h>
 #endif
 
+#include "dudect/cpucycles.h"
 #include "dudect/fixture.h"
 #include "list.h"
 #include "random.h"
+#include "shannon_entropy.h"
+#include "taskpool.h"
 
 /* Shannon entropy */
-extern double shannon_entropy(const uint8_t *input_data);
 extern int show_entropy;
 
 /* Our program needs to use regular malloc/free */
@@ -43,6 +50,7 @@ extern int show_entropy;
  * solution code
  */
 #include "queue.h"
+#include "skiplist.h"
 
 #include "console.h"
 #include "report.h"
@@ -76,8 +84,13 @@ static int string_length = MAXSTRING;
 static int descend = 0;
 
 #define MIN_RANDSTR_LEN 5
-#define MAX_RANDSTR_LEN 10
+#define MAX_RANDSTR_LEN 9
 static const char charset[] = "abcdefghijklmnopqrstuvwxyz";
+
+/* Lengths of RAND strings, drawn uniformly from [randmin, randmax] */
+#define RANDSTR_LIMIT 1024
+static int randstr_min = MIN_RANDSTR_LEN;
+static int randstr_max = MAX_RANDSTR_LEN;
 /* For queue_insert and queue_remove */
 typedef enum {
     POS_TAIL,
@@ -85,6 +98,161 @@ typedef enum {
 } position_t;
 /* Forward declarations */
 static bool q_show(int vlevel);
+uintptr_t os_random(uintptr_t seed);
+
+/* A read-only view is a queue whose values point straight into a private
+ * mapping of a file holding one string per line.  The newline after each
+ * string is overwritten with its terminator, so every page holding a newline,
+ * which is nearly all of them, is copied by the kernel as it is written; but
+ * that is one copy by the page, and no value is allocated or copied on its
+ * own.  All nodes come from one array, which lives until no queue is left, so
+ * a view may be reordered (sort, merge, dedup, reverse, ...) but its nodes
+ * must never be freed one by one, nor mixed with heap-allocated ones.
+ */
+typedef struct {
+    struct list_head list;
+    element_t *nodes;
+    size_t n;
+    char *map;
+    size_t map_size;
+} queue_view_t;
+
+static LIST_HEAD(views);
+
+/* The view whose nodes make up queue q, if any */
+static queue_view_t *view_of(struct list_head *q)
+{
+    if (!q || list_empty(q))
+        return NULL;
+
+    element_t *e = list_first_entry(q, element_t, list);
+    queue_view_t *v;
+    list_for_each_entry (v, &views, list) {
+        if (e >= v->nodes && e < v->nodes + v->n)
+            return v;
+    }
+    return NULL;
+}
+
+/* Refuse commands that allocate or free nodes on a view */
+static bool view_refuse(char *cmd)
+{
+    if (!current || !view_of(current->q))
+        return false;
+    report(1, "ERROR: %s is not supported on a read-only view", cmd);
+    return true;
+}
+
+/* Free the queue of ctx, leaving the nodes of a view alone */
+static void queue_free(queue_contex_t *ctx)
+{
+    if (view_of(ctx->q))
+        INIT_LIST_HEAD(ctx->q);
+    STATS_BEGIN(free);
+    q_free(ctx->q);
+    STATS_END();
+}
+
+/* Once the chain is empty, nothing refers to any view any more */
+static void views_release()
+{
+    queue_view_t *v, *tmp;
+    list_for_each_entry_safe (v, tmp, &views, list) {
+        list_del(&v->list);
+        free(v->nodes);
+        munmap(v->map, v->map_size);
+        free(v);
+    }
+}
+
+/* Unlink every element whose value occurs more than once, as q_delete_dup()
+ * would, but without freeing anything.  Return the number unlinked.
+ */
+static int view_delete_dup(struct list_head *head)
+{
+    int removed = 0;
+    struct list_head *cur = head->next;
+    while (cur != head) {
+        const char *value = list_entry(cur, element_t, list)->value;
+        struct list_head *next = cur->next;
+        while (next != head &&
+               !strcmp(list_entry(next, element_t, list)->value, value))
+            next = next->next;
+        if (next != cur->next) {
+            for (struct list_head *p = cur; p != next; p = p->next)
+                removed++;
+            cur->prev->next = next;
+            next->prev = cur->prev;
+        }
+        cur = next;
+    }
+    return removed;
+}
+
+/* A sorted queue puts every insertion at its sorted position, found through a
+ * skip list index over the queue, so that sort has nothing left to do and
+ * sorted queues can be merged as they are.  Operations that remove elements
+ * other than at either end rebuild the index; those that reorder the queue
+ * make it an ordinary one.
+ */
+typedef struct {
+    struct list_head list;
+    queue_contex_t *ctx;
+    skiplist_t *index;
+} sorted_queue_t;
+
+static LIST_HEAD(sorted_queues);
+
+/* The index of the queue of ctx, if it is kept sorted */
+static skiplist_t *index_of(queue_contex_t *ctx)
+{
+    sorted_queue_t *sq;
+    list_for_each_entry (sq, &sorted_queues, list) {
+        if (sq->ctx == ctx)
+            return sq->index;
+    }
+    return NULL;
+}
+
+/* Stop keeping the queue of ctx sorted, if it is */
+static void sorted_drop(queue_contex_t *ctx)
+{
+    sorted_queue_t *sq, *tmp;
+    list_for_each_entry_safe (sq, tmp, &sorted_queues, list) {
+        if (sq->ctx == ctx) {
+            list_del(&sq->list);
+            sl_free(sq->index);
+            free(sq);
+        }
+    }
+}
+
+static void sorted_release()
+{
+    sorted_queue_t *sq, *tmp;
+    list_for_each_entry_safe (sq, tmp, &sorted_queues, list) {
+        list_del(&sq->list);
+        sl_free(sq->index);
+        free(sq);
+    }
+}
+
+/* After an operation that may have removed elements anywhere */
+static void sorted_refresh(queue_contex_t *ctx)
+{
+    skiplist_t *index = ctx ? index_of(ctx) : NULL;
+    if (index)
+        sl_rebuild(index, sl_descend(index));
+}
+
+/* After an operation that reordered the queue */
+static void sorted_disorder(queue_contex_t *ctx)
+{
+    if (ctx && index_of(ctx)) {
+        sorted_drop(ctx);
+        report(3, "Queue %d is no longer kept sorted", ctx->id);
+    }
+}
 
 static bool do_free(int argc, char *argv[])
 {
@@ -114,16 +282,19 @@ static bool do_free(int argc, char *argv[])
         list_del(&current->chain);
 
         if (exception_setup(true))
-            q_free(current->q);
+            queue_free(current);
         exception_cancel();
         set_cautious_mode(true);
     }
 
     if (current) {
+        sorted_drop(current);
         free(current);
         chain.size--;
         current = qnext ? list_entry(qnext, queue_contex_t, chain) : NULL;
     }
+    if (!chain.size)
+        views_release();
 
     q_show(3);
 
@@ -140,8 +311,9 @@ static bool do_free(int argc, char *argv[])
 
 static bool do_new(int argc, char *argv[])
 {
-    if (argc != 1) {
-        report(1, "%s takes no arguments", argv[0]);
+    bool sorted = argc == 2 && !strcmp(argv[1], "sorted");
+    if (argc != 1 && !sorted) {
+        report(1, "%s takes no arguments but 'sorted'", argv[0]);
         return false;
     }
 
@@ -152,53 +324,184 @@ static bool do_new(int argc, char *argv[])
         list_add_tail(&qctx->chain, &chain.head);
 
         qctx->size = 0;
+        STATS_BEGIN(new);
         qctx->q = q_new();
+        STATS_END();
         qctx->id = chain.size++;
 
         current = qctx;
     }
     exception_cancel();
+
+    if (sorted && current && current->q) {
+        sorted_queue_t *sq = malloc(sizeof(sorted_queue_t));
+        skiplist_t *index = sq ? sl_new(current->q, descend) : NULL;
+        if (!index) {
+            free(sq);
+            report(1, "ERROR: Could not allocate the index of a sorted queue");
+            ok = false;
+        } else {
+            sq->ctx = current;
+            sq->index = index;
+            list_add_tail(&sq->list, &sorted_queues);
+        }
+    }
     q_show(3);
 
     return ok && !error_check();
 }
 
-/* TODO: Add a buf_size check of if the buf_size may be less
- * than MIN_RANDSTR_LEN.
+/* RAND strings are cut from a pool generated a block at a time, rather than
+ * asking for random bytes and a length for every insertion.
+ */
+#define RANDSTR_POOL_SIZE (64 * 1024)
+static char randstr_pool[RANDSTR_POOL_SIZE];
+static size_t randstr_pos, randstr_end;
+
+/* Random bits left over for drawing lengths */
+static uint64_t randstr_bits;
+static int randstr_nbits;
+
+/* Fill buf with n letters of charset.  Test strings need no secrecy, so
+ * they come from the fast generator.  Each letter takes 16 random bits r,
+ * and is the high half of r * 26 unless the low half falls below
+ * 2^16 mod 26, which rejects the values that would make some letters more
+ * likely than others (Lemire's method).  That happens once in 2520 draws,
+ * so the branch is all but free.
+ */
+static void fill_letters(char *buf, size_t n)
+{
+    const uint32_t range = sizeof(charset) - 1;
+    const uint32_t threshold = (65536 - range) % range;
+    char *dst = buf, *end = buf + n;
+    uint64_t words[64];
+    while (dst < end) {
+        randombytes_fast((uint8_t *) words, sizeof(words));
+        for (int k = 0; k < 64 && dst < end; k++) {
+            uint64_t w = words[k];
+            for (int j = 0; j < 4 && dst < end; j++, w >>= 16) {
+                uint32_t m = (uint32_t) (w & 0xffff) * range;
+                if ((m & 0xffff) < threshold)
+                    continue;
+                *dst++ = charset[m >> 16];
+            }
+        }
+    }
+}
+
+/* Uniform length in [randstr_min, randstr_max], from 16 random bits */
+static size_t rand_length(void)
+{
+    uint32_t range = randstr_max - randstr_min + 1;
+    uint32_t limit = 65536 - 65536 % range, v;
+    do {
+        if (randstr_nbits == 0) {
+            randombytes_fast((uint8_t *) &randstr_bits, sizeof(randstr_bits));
+            randstr_nbits = 64;
+        }
+        v = randstr_bits & 0xffff;
+        randstr_bits >>= 16;
+        randstr_nbits -= 16;
+    } while (v >= limit);
+    return randstr_min + v % range;
+}
+
+/* Fill the pool with letters, then cut it into strings by writing the
+ * terminating NULs over some of them.
  */
-static void fill_rand_string(char *buf, size_t buf_size)
+static void randstr_refill(void)
+{
+    fill_letters(randstr_pool, RANDSTR_POOL_SIZE);
+    size_t pos = 0, len;
+    while (pos + (len = rand_length()) < RANDSTR_POOL_SIZE) {
+        pos += len;
+        randstr_pool[pos++] = '\0';
+    }
+    randstr_pos = 0;
+    randstr_end = pos;
+}
+
+static char *next_rand_string(void)
+{
+    if (randstr_pos >= randstr_end)
+        randstr_refill();
+    char *s = randstr_pool + randstr_pos;
+    randstr_pos += strlen(s) + 1;
+    return s;
+}
+
+/* Drop the strings and bits drawn so far */
+static void randstr_flush(void)
 {
-    size_t len = 0;
-    while (len < MIN_RANDSTR_LEN)
-        len = rand() % buf_size;
+    randstr_pos = randstr_end = 0;
+    randstr_nbits = 0;
+}
 
-    randombytes((uint8_t *) buf, len);
-    for (size_t n = 0; n < len; n++)
-        buf[n] = charset[buf[n] % (sizeof(charset) - 1)];
-    buf[len] = '\0';
+/* Setters for randmin and randmax, which drop strings of the old lengths */
+static bool randstr_check(void)
+{
+    randstr_flush();
+    if (randstr_min < 0 || randstr_max >= RANDSTR_LIMIT ||
+        randstr_min > randstr_max) {
+        report(1, "RAND lengths must satisfy 0 <= randmin <= randmax < %d",
+               RANDSTR_LIMIT);
+        return false;
+    }
+    return true;
+}
+
+static void randmin_changed(int oldval)
+{
+    if (!randstr_check())
+        randstr_min = oldval;
+}
+
+static void randmax_changed(int oldval)
+{
+    if (!randstr_check())
+        randstr_max = oldval;
+}
+
+/* Seed of every random choice qtest makes, or 0 to seed from the system */
+static int seed = 0;
+
+static void seed_changed(int oldval)
+{
+    randombytes_set_seed((unsigned) seed);
+    srandom(seed ? (unsigned) seed : os_random(getpid() ^ getppid()));
+    randstr_flush();
+}
+
+/* Test an operation for timing leaks in place of running the command.  O(1)
+ * operations are timed against the length of the queue, the others against
+ * the values held by a queue of fixed length.
+ */
+static bool simulate(int argc, char *argv[], bool (*is_const)(void))
+{
+    if (argc != 1) {
+        report(1, "%s does not need arguments in simulation mode", argv[0]);
+        return false;
+    }
+    if (!is_const()) {
+        report(1, "ERROR: Probably not constant time or wrong implementation");
+        return false;
+    }
+    report(1, "Probably constant time");
+    return true;
 }
 
 /* insertion */
 static bool queue_insert(position_t pos, int argc, char *argv[])
 {
-    if (simulation) {
-        if (argc != 1) {
-            report(1, "%s does not need arguments in simulation mode", argv[0]);
-            return false;
-        }
-        bool ok =
-            pos == POS_TAIL ? is_insert_tail_const() : is_insert_head_const();
-        if (!ok) {
-            report(1,
-                   "ERROR: Probably not constant time or wrong implementation");
-            return false;
-        }
-        report(1, "Probably constant time");
-        return ok;
-    }
+    if (simulation)
+        return simulate(argc, argv,
+                        pos == POS_TAIL ? is_insert_tail_const
+                                        : is_insert_head_const);
+
+    if (view_refuse(argv[0]))
+        return false;
 
     char *lasts = NULL;
-    char randstr_buf[MAX_RANDSTR_LEN];
     int reps = 1;
     bool ok = true, need_rand = false;
     if (argc != 2 && argc != 3) {
@@ -214,22 +517,28 @@ static bool queue_insert(position_t pos, int argc, char *argv[])
         }
     }
 
-    if (!strcmp(inserts, "RAND")) {
+    if (!strcmp(inserts, "RAND"))
         need_rand = true;
-        inserts = randstr_buf;
-    }
 
     if (!current || !current->q)
         report(3, "Warning: Calling insert %s on null queue",
                pos == POS_TAIL ? "tail" : "head");
     error_check();
 
+    skiplist_t *index = current ? index_of(current) : NULL;
     if (current && exception_setup(true)) {
         for (int r = 0; ok && r < reps; r++) {
             if (need_rand)
-                fill_rand_string(randstr_buf, sizeof(randstr_buf));
-            bool rval = pos == POS_TAIL ? q_insert_tail(current->q, inserts)
-                                        : q_insert_head(current->q, inserts);
+                inserts = next_rand_string();
+            bool rval;
+            if (pos == POS_TAIL) {
+                STATS_BEGIN(insert_tail);
+                rval = q_insert_tail(current->q, inserts);
+            } else {
+                STATS_BEGIN(insert_head);
+                rval = q_insert_head(current->q, inserts);
+            }
+            STATS_END();
             if (rval) {
                 current->size++;
                 element_t *entry =
@@ -254,6 +563,9 @@ static bool queue_insert(position_t pos, int argc, char *argv[])
                     break;
                 }
                 lasts = cur_inserts;
+                /* Move it from the end to its sorted position */
+                if (index)
+                    sl_insert(index, entry);
             } else {
                 fail_count++;
                 if (fail_count < fail_limit)
@@ -293,21 +605,10 @@ static bool queue_remove(position_t pos, int argc, char *argv[])
      * We shall figure out the exact reasons and resolve later.
      */
 #if !(defined(__aarch64__) && defined(__APPLE__))
-    if (simulation) {
-        if (argc != 1) {
-            report(1, "%s does not need arguments in simulation mode", argv[0]);
-            return false;
-        }
-        bool ok =
-            pos == POS_TAIL ? is_remove_tail_const() : is_remove_head_const();
-        if (!ok) {
-            report(1,
-                   "ERROR: Probably not constant time or wrong implementation");
-            return false;
-        }
-        report(1, "Probably constant time");
-        return ok;
-    }
+    if (simulation)
+        return simulate(argc, argv,
+                        pos == POS_TAIL ? is_remove_tail_const
+                                        : is_remove_head_const);
 #endif
 
     if (argc != 1 && argc != 2) {
@@ -315,6 +616,9 @@ static bool queue_remove(position_t pos, int argc, char *argv[])
         return false;
     }
 
+    if (view_refuse(argv[0]))
+        return false;
+
     char *removes = malloc(string_length + STRINGPAD + 1);
     if (!removes) {
         report(1,
@@ -346,13 +650,41 @@ static bool queue_remove(position_t pos, int argc, char *argv[])
                pos == POS_TAIL ? "tail" : "head");
     error_check();
 
+    /* The element the remove should take, should the queue be indexed */
+    skiplist_t *index = current ? index_of(current) : NULL;
+    element_t *end = NULL;
+    if (index && current->q && !list_empty(current->q))
+        end = pos == POS_TAIL ? list_last_entry(current->q, element_t, list)
+                              : list_first_entry(current->q, element_t, list);
+
     element_t *re = NULL;
-    if (current && exception_setup(true))
-        re = pos == POS_TAIL
-                 ? q_remove_tail(current->q, removes, string_length + 1)
-                 : q_remove_head(current->q, removes, string_length + 1);
+    if (current && exception_setup(true)) {
+        if (pos == POS_TAIL) {
+            STATS_BEGIN(remove_tail);
+            re = q_remove_tail(current->q, removes, string_length + 1);
+        } else {
+            STATS_BEGIN(remove_head);
+            re = q_remove_head(current->q, removes, string_length + 1);
+        }
+        STATS_END();
+    }
     exception_cancel();
 
+    /* Drop the tower of what was removed, before the element goes.  Should
+     * the remove have failed or taken another element, the queue may have
+     * changed in any way, so index it again.
+     */
+    if (index) {
+        if (re && re == end) {
+            if (pos == POS_TAIL)
+                sl_forget_last(index, re);
+            else
+                sl_forget_first(index, re);
+        } else {
+            sl_rebuild(index, sl_descend(index));
+        }
+    }
+
     bool is_null = re ? false : true;
 
     if (!is_null) {
@@ -427,6 +759,13 @@ static bool do_dedup(int argc, char *argv[])
         return false;
     }
 
+    /* The nodes of a view are not ours to free */
+    if (view_of(current->q)) {
+        current->size -= view_delete_dup(current->q);
+        q_show(3);
+        return !error_check();
+    }
+
     LIST_HEAD(l_copy);
     element_t *item = NULL, *tmp = NULL;
 
@@ -461,9 +800,13 @@ static bool do_dedup(int argc, char *argv[])
     }
 
     bool ok = true;
-    if (exception_setup(true))
+    if (exception_setup(true)) {
+        STATS_BEGIN(delete_dup);
         ok = q_delete_dup(current->q);
+        STATS_END();
+    }
     exception_cancel();
+    sorted_refresh(current);
 
     if (!ok) {
         list_for_each_entry_safe (item, tmp, &l_copy, list) {
@@ -512,6 +855,9 @@ static bool do_dedup(int argc, char *argv[])
 
 static bool do_reverse(int argc, char *argv[])
 {
+    if (simulation)
+        return simulate(argc, argv, is_reverse_const);
+
     if (argc != 1) {
         report(1, "%s takes no arguments", argv[0]);
         return false;
@@ -522,9 +868,13 @@ static bool do_reverse(int argc, char *argv[])
     error_check();
 
     set_noallocate_mode(true);
-    if (current && exception_setup(true))
+    if (current && exception_setup(true)) {
+        STATS_BEGIN(reverse);
         q_reverse(current->q);
+        STATS_END();
+    }
     exception_cancel();
+    sorted_disorder(current);
 
     set_noallocate_mode(false);
     q_show(3);
@@ -533,6 +883,9 @@ static bool do_reverse(int argc, char *argv[])
 
 static bool do_size(int argc, char *argv[])
 {
+    if (simulation)
+        return simulate(argc, argv, is_size_const);
+
     if (argc != 1 && argc != 2) {
         report(1, "%s takes 0-1 arguments", argv[0]);
         return false;
@@ -557,7 +910,9 @@ static bool do_size(int argc, char *argv[])
 
     if (current && exception_setup(true)) {
         for (int r = 0; ok && r < reps; r++) {
+            STATS_BEGIN(size);
             cnt = q_size(current->q);
+            STATS_END();
             ok = ok && !error_check();
         }
     }
@@ -579,8 +934,45 @@ static bool do_size(int argc, char *argv[])
     return ok && !error_check();
 }
 
+#ifdef ENABLE_STATS
+/* Whether to report the comparisons and relinks of every sort and merge.
+ * Unlike times, these counts are the same on every run of the same input.
+ */
+static int profile = 0;
+static stats_counts_t profile_start;
+
+static void profile_begin(int op)
+{
+    if (profile)
+        stats_get(op, &profile_start);
+}
+
+/* Report what the call of op since profile_begin() did to n elements */
+static void profile_end(int op, const char *name, int n)
+{
+    if (!profile)
+        return;
+    stats_counts_t end;
+    stats_get(op, &end);
+    uint64_t cmps = end.cmps - profile_start.cmps;
+    uint64_t relinks = end.relinks - profile_start.relinks;
+    double nlogn = n > 1 ? n * log2(n) : 0;
+    report(1, "%s: n = %d, %" PRIu64 " comparisons (%.3f n log2 n), %" PRIu64
+           " relinks", name, n, cmps, nlogn ? cmps / nlogn : 0.0, relinks);
+}
+
+#define PROFILE_BEGIN(x) profile_begin(STAT_##x)
+#define PROFILE_END(x, n) profile_end(STAT_##x, #x, n)
+#else
+#define PROFILE_BEGIN(x) ((void) 0)
+#define PROFILE_END(x, n) ((void) 0)
+#endif
+
 bool do_sort(int argc, char *argv[])
 {
+    if (simulation)
+        return simulate(argc, argv, is_sort_const);
+
     if (argc != 1) {
         report(1, "%s takes no arguments", argv[0]);
         return false;
@@ -597,11 +989,22 @@ bool do_sort(int argc, char *argv[])
         report(3, "Warning: Calling sort on single node");
     error_check();
 
+    /* A sorted queue is already in order, unless the order was changed */
+    skiplist_t *index = current ? index_of(current) : NULL;
+    bool presorted = index && sl_descend(index) == !!descend;
+
+    PROFILE_BEGIN(sort);
     set_noallocate_mode(true);
-    if (current && exception_setup(true))
+    if (current && !presorted && exception_setup(true)) {
+        STATS_BEGIN(sort);
         q_sort(current->q, descend);
+        STATS_END();
+    }
     exception_cancel();
     set_noallocate_mode(false);
+    PROFILE_END(sort, cnt);
+    if (index && !presorted)
+        sl_rebuild(index, descend);
 
     bool ok = true;
     if (current && current->size) {
@@ -631,6 +1034,9 @@ bool do_sort(int argc, char *argv[])
 
 static bool do_dm(int argc, char *argv[])
 {
+    if (simulation)
+        return simulate(argc, argv, is_delete_mid_const);
+
     if (argc != 1) {
         report(1, "%s takes no arguments", argv[0]);
         return false;
@@ -642,10 +1048,17 @@ static bool do_dm(int argc, char *argv[])
     }
     error_check();
 
+    if (view_refuse(argv[0]))
+        return false;
+
     bool ok = true;
-    if (exception_setup(true))
+    if (exception_setup(true)) {
+        STATS_BEGIN(delete_mid);
         ok = q_delete_mid(current->q);
+        STATS_END();
+    }
     exception_cancel();
+    sorted_refresh(current);
 
     if (!current->size)
         report(3, "Warning: Try to delete middle node to empty queue");
@@ -657,6 +1070,9 @@ static bool do_dm(int argc, char *argv[])
 
 static bool do_swap(int argc, char *argv[])
 {
+    if (simulation)
+        return simulate(argc, argv, is_swap_const);
+
     if (argc != 1) {
         report(1, "%s takes no arguments", argv[0]);
         return false;
@@ -669,9 +1085,13 @@ static bool do_swap(int argc, char *argv[])
     error_check();
 
     set_noallocate_mode(true);
-    if (exception_setup(true))
+    if (exception_setup(true)) {
+        STATS_BEGIN(swap);
         q_swap(current->q);
+        STATS_END();
+    }
     exception_cancel();
+    sorted_disorder(current);
 
     set_noallocate_mode(false);
 
@@ -693,6 +1113,9 @@ static bool do_ascend(int argc, char *argv[])
     }
     error_check();
 
+    if (view_refuse(argv[0]))
+        return false;
+
 
     int cnt = q_size(current->q);
     if (!cnt)
@@ -701,9 +1124,13 @@ static bool do_ascend(int argc, char *argv[])
         report(3, "Warning: Calling ascend on single node");
     error_check();
 
-    if (exception_setup(true))
+    if (exception_setup(true)) {
+        STATS_BEGIN(ascend);
         current->size = q_ascend(current->q);
+        STATS_END();
+    }
     set_noallocate_mode(false);
+    sorted_refresh(current);
 
     bool ok = true;
 
@@ -740,6 +1167,9 @@ static bool do_descend(int argc, char *argv[])
     }
     error_check();
 
+    if (view_refuse(argv[0]))
+        return false;
+
 
     int cnt = q_size(current->q);
     if (!cnt)
@@ -748,9 +1178,13 @@ static bool do_descend(int argc, char *argv[])
         report(3, "Warning: Calling descend on single node");
     error_check();
 
-    if (exception_setup(true))
+    if (exception_setup(true)) {
+        STATS_BEGIN(descend);
         current->size = q_descend(current->q);
+        STATS_END();
+    }
     set_noallocate_mode(false);
+    sorted_refresh(current);
 
     bool ok = true;
 
@@ -795,17 +1229,80 @@ static bool do_reverseK(int argc, char *argv[])
     }
 
     set_noallocate_mode(true);
-    if (exception_setup(true))
+    if (exception_setup(true)) {
+        STATS_BEGIN(reverseK);
         q_reverseK(current->q, k);
+        STATS_END();
+    }
     exception_cancel();
+    sorted_disorder(current);
 
     set_noallocate_mode(false);
     q_show(3);
     return !error_check();
 }
 
+/* Operations on every queue of the chain at once run in parallel, one task
+ * per queue, on a pool of threads started on first use.
+ */
+#define MAX_THREADS 64
+static int threads = 0;
+static tpool_t *pool = NULL;
+
+/* Set once tasks outlived the time limit, and with them the pool */
+static bool pool_lost = false;
+
+static void threads_changed(int oldval)
+{
+    if (threads < 0 || threads > MAX_THREADS) {
+        report(1, "threads must be between 0 and %d", MAX_THREADS);
+        threads = oldval;
+        return;
+    }
+    /* Started again with as many workers on next use */
+    tpool_free(pool);
+    pool = NULL;
+}
+
+static tpool_t *get_pool()
+{
+    if (pool_lost) {
+        report(1, "ERROR: No more threads, since tasks could not be stopped");
+        return NULL;
+    }
+    if (!pool) {
+        long n = threads ? threads : sysconf(_SC_NPROCESSORS_ONLN);
+        n = n < 1 ? 1 : n > MAX_THREADS ? MAX_THREADS : n;
+        pool = tpool_new(n);
+        if (!pool)
+            report(1, "ERROR: Could not start %ld threads", n);
+    }
+    return pool;
+}
+
+static void pool_abandon();
+
+/* q_merge() on a worker, which outlives the merges it spawns even should a
+ * time limit cut the wait for it short
+ */
+typedef struct {
+    tpool_task_t task;
+    int len;
+} merge_call_t;
+
+static void merge_call(tpool_task_t *task)
+{
+    merge_call_t *call = container_of(task, merge_call_t, task);
+    STATS_BEGIN(merge);
+    call->len = q_merge(&chain.head, descend);
+    STATS_END();
+}
+
 static bool do_merge(int argc, char *argv[])
 {
+    if (simulation)
+        return simulate(argc, argv, is_merge_const);
+
     if (argc != 1) {
         report(1, "%s takes no arguments", argv[0]);
         return false;
@@ -817,12 +1314,62 @@ static bool do_merge(int argc, char *argv[])
     }
     error_check();
 
+    /* Heap nodes merged into a view could never be freed, and vice versa */
+    int views_seen = 0, heaps_seen = 0;
+    queue_contex_t *ctx;
+    list_for_each_entry (ctx, &chain.head, chain) {
+        if (view_of(ctx->q))
+            views_seen++;
+        else if (ctx->q && !list_empty(ctx->q))
+            heaps_seen++;
+    }
+    if (views_seen && heaps_seen) {
+        report(1, "ERROR: Cannot merge read-only views with other queues");
+        return false;
+    }
+
+    /* Merge pairs of queues in parallel when there are more than two */
+    tpool_t *p = chain.size > 2 && !pool_lost ? get_pool() : NULL;
+    merge_call_t *call = p ? malloc(sizeof(merge_call_t)) : NULL;
+    q_merge_pool(call ? p : NULL);
+
     int len = 0;
+    PROFILE_BEGIN(merge);
     set_noallocate_mode(true);
-    if (current && exception_setup(true))
+    if (call) {
+        tpool_task_init(&call->task, merge_call);
+        if (exception_setup(true)) {
+            tpool_spawn(p, &call->task);
+            tpool_wait(p);
+        }
+    } else if (current && exception_setup(true)) {
+        STATS_BEGIN(merge);
         len = q_merge(&chain.head, descend);
+        STATS_END();
+    }
     exception_cancel();
     set_noallocate_mode(false);
+    q_merge_pool(NULL);
+    if (call) {
+        /* The time limit stops the waiting, but not the merges, which still
+         * use the chain and the task
+         */
+        if (!tpool_idle(p)) {
+            pool_abandon();
+            return false;
+        }
+        len = call->len;
+        free(call);
+    }
+    PROFILE_END(merge, len);
+
+    /* Only the first queue is left, in the order of option descend */
+    list_for_each_entry (ctx, &chain.head, chain) {
+        if (ctx->chain.prev != &chain.head)
+            sorted_drop(ctx);
+        else if (index_of(ctx))
+            sl_rebuild(index_of(ctx), descend);
+    }
 
     if (q_size(&chain.head) > 1) {
         chain.size = 1;
@@ -833,7 +1380,9 @@ static bool do_merge(int argc, char *argv[])
         while ((uintptr_t) cur != (uintptr_t) &chain.head) {
             queue_contex_t *ctx = list_entry(cur, queue_contex_t, chain);
             cur = cur->next;
+            STATS_BEGIN(free);
             q_free(ctx->q);
+            STATS_END();
             free(ctx);
         }
 
@@ -875,6 +1424,215 @@ static bool do_merge(int argc, char *argv[])
     return ok && !error_check();
 }
 
+typedef struct {
+    tpool_task_t task;
+    queue_contex_t *ctx;
+    bool skip; /* Nothing to do for it */
+    bool ok;
+} queue_task_t;
+
+/* Whether q is in the order asked for by option descend */
+static bool in_order(struct list_head *q)
+{
+    if (!q)
+        return true;
+    for (struct list_head *cur = q->next; cur != q && cur->next != q;
+         cur = cur->next) {
+        int cmp = strcmp(list_entry(cur, element_t, list)->value,
+                         list_entry(cur->next, element_t, list)->value);
+        if (descend ? cmp < 0 : cmp > 0)
+            return false;
+    }
+    return true;
+}
+
+static void sort_task(tpool_task_t *task)
+{
+    queue_task_t *t = container_of(task, queue_task_t, task);
+    if (!t->skip) {
+        STATS_BEGIN(sort);
+        q_sort(t->ctx->q, descend);
+        STATS_END();
+    }
+    t->ok = in_order(t->ctx->q);
+}
+
+static void free_task(tpool_task_t *task)
+{
+    queue_task_t *t = container_of(task, queue_task_t, task);
+    queue_free(t->ctx);
+    t->ok = true;
+}
+
+/* Tasks of the pool are still running, past the time limit or after one of
+ * them faulted.  Nothing can stop them, so leave them the pool, the queues of
+ * the chain and the views they may be working on, and touch none of these
+ * again.
+ */
+static void pool_abandon()
+{
+    if (tpool_faulted(pool))
+        report(1,
+               "ERROR: Segmentation fault occurred in a thread.  You "
+               "dereferenced a NULL or invalid pointer");
+    report(1, "ERROR: Tasks still running; leaving them their queues");
+    pool = NULL;
+    pool_lost = true;
+    INIT_LIST_HEAD(&chain.head);
+    INIT_LIST_HEAD(&views);
+    sorted_release();
+    chain.size = 0;
+    current = NULL;
+}
+
+/* Run a task on every queue of the chain and wait for all of them.  Return
+ * the tasks, in chain order, for the caller to look at and free, or NULL if
+ * none could be run or some are still running.
+ */
+static queue_task_t *run_on_all(void (*run)(tpool_task_t *task))
+{
+    tpool_t *p = get_pool();
+    queue_task_t *tasks = p ? calloc(chain.size, sizeof(queue_task_t)) : NULL;
+    if (!tasks)
+        return NULL;
+
+    int n = 0;
+    queue_contex_t *ctx;
+    list_for_each_entry (ctx, &chain.head, chain) {
+        skiplist_t *index = index_of(ctx);
+        tasks[n].ctx = ctx;
+        tasks[n].skip = index && sl_descend(index) == !!descend;
+        tpool_task_init(&tasks[n++].task, run);
+    }
+
+    if (exception_setup(true)) {
+        for (int i = 0; i < n; i++)
+            tpool_spawn(p, &tasks[i].task);
+        tpool_wait(p);
+    }
+    exception_cancel();
+    /* The time limit stops the waiting, but not the tasks, which still use
+     * the task array
+     */
+    if (!tpool_idle(p)) {
+        pool_abandon();
+        return NULL;
+    }
+    return tasks;
+}
+
+/* Whether a queue of the chain is too big to free in cautious mode, where
+ * every free looks the block up among all those allocated
+ */
+static bool chain_has_big()
+{
+    queue_contex_t *ctx;
+    list_for_each_entry (ctx, &chain.head, chain) {
+        if (ctx->size > BIG_LIST_SIZE)
+            return true;
+    }
+    return false;
+}
+
+/* Free the contexts of the chain, once their queues are gone */
+static void chain_clear()
+{
+    queue_contex_t *ctx, *tmp;
+    list_for_each_entry_safe (ctx, tmp, &chain.head, chain)
+        free(ctx);
+    INIT_LIST_HEAD(&chain.head);
+    sorted_release();
+    chain.size = 0;
+    current = NULL;
+}
+
+static bool sort_all()
+{
+    set_noallocate_mode(true);
+    queue_task_t *tasks = run_on_all(sort_task);
+    set_noallocate_mode(false);
+    if (!tasks)
+        return false;
+
+    bool ok = true;
+    for (int i = 0; i < chain.size; i++) {
+        skiplist_t *index = index_of(tasks[i].ctx);
+        if (index && !tasks[i].skip)
+            sl_rebuild(index, descend);
+        if (!tasks[i].ok) {
+            report(1, "ERROR: Queue %d not sorted in %s order",
+                   tasks[i].ctx->id, descend ? "descending" : "ascending");
+            ok = false;
+        }
+    }
+    free(tasks);
+    return ok;
+}
+
+static bool do_sortall(int argc, char *argv[])
+{
+    if (argc != 1) {
+        report(1, "%s takes no arguments", argv[0]);
+        return false;
+    }
+
+    if (!chain.size) {
+        report(3, "Warning: Calling sortall with no queue");
+        return false;
+    }
+    error_check();
+
+    bool ok = sort_all();
+    q_show(3);
+    return ok && !error_check();
+}
+
+static bool do_freeall(int argc, char *argv[])
+{
+    if (argc != 1) {
+        report(1, "%s takes no arguments", argv[0]);
+        return false;
+    }
+
+    if (!chain.size)
+        report(3, "Warning: There is no available queue");
+    error_check();
+
+    if (chain_has_big())
+        set_cautious_mode(false);
+    queue_task_t *tasks = chain.size ? run_on_all(free_task) : NULL;
+    set_cautious_mode(true);
+    if (chain.size && !tasks)
+        return false;
+    free(tasks);
+    chain_clear();
+    views_release();
+
+    q_show(3);
+
+    bool ok = true;
+    size_t bcnt = allocation_check();
+    if (bcnt > 0) {
+        report(1,
+               "ERROR: There is no queue, but %lu blocks are still allocated",
+               bcnt);
+        ok = false;
+    }
+
+    return ok && !error_check();
+}
+
+static bool do_pmerge(int argc, char *argv[])
+{
+    if (simulation || argc != 1 || !chain.size)
+        return do_merge(argc, argv);
+
+    error_check();
+    if (!sort_all())
+        return false;
+    return do_merge(argc, argv);
+}
+
 static bool is_circular()
 {
     struct list_head *cur = current->q->next;
@@ -915,16 +1673,30 @@ static bool q_show(int vlevel)
     struct list_head *ori = current->q;
     struct list_head *cur = current->q->next;
 
+    /* Compute the entropy of every displayed element in one batch, and leave
+     * it out if the batch is cut short
+     */
+    double entropy[BIG_LIST_SIZE];
+    volatile int scored = 0;
+    if (show_entropy && exception_setup(true)) {
+        const uint8_t *values[BIG_LIST_SIZE];
+        int n = 0;
+        for (struct list_head *p = cur;
+             p != ori && n < BIG_LIST_SIZE && n < current->size; p = p->next)
+            values[n++] =
+                (const uint8_t *) list_entry(p, element_t, list)->value;
+        shannon_entropy_batch(values, n, entropy);
+        scored = n;
+    }
+    exception_cancel();
+
     if (exception_setup(true)) {
         while (ok && ori != cur && cnt < current->size) {
             element_t *e = list_entry(cur, element_t, list);
             if (cnt < BIG_LIST_SIZE) {
                 report_noreturn(vlevel, cnt == 0 ? "%s" : " %s", e->value);
-                if (show_entropy) {
-                    report_noreturn(
-                        vlevel, "(%3.2f%%)",
-                        shannon_entropy((const uint8_t *) e->value));
-                }
+                if (cnt < scored)
+                    report_noreturn(vlevel, "(%3.2f%%)", entropy[cnt]);
             }
             cnt++;
             cur = cur->next;
@@ -966,6 +1738,444 @@ static bool do_show(int argc, char *argv[])
     return q_show(0);
 }
 
+/* Fit the running time of the named operations, or of all of them, to an
+ * asymptotic class.
+ */
+static bool do_complexity(int argc, char *argv[])
+{
+    int modes[N_DUTS], n = 0;
+    if (argc == 1) {
+        for (; n < N_DUTS; n++)
+            modes[n] = n;
+    }
+    for (int i = 1; i < argc; i++) {
+        int mode = dut_lookup(argv[i]);
+        if (mode < 0) {
+            report(1, "Unknown operation '%s'", argv[i]);
+            return false;
+        }
+        if (n < N_DUTS)
+            modes[n++] = mode;
+    }
+
+    /* The timed queues are over BIG_LIST_SIZE, and freed out of order */
+    set_cautious_mode(false);
+    bool ok = true;
+    for (int i = 0; i < n; i++) {
+        complexity_t big_o;
+        double rms;
+        if (!complexity_fit(modes[i], &big_o, &rms)) {
+            report(1, "ERROR: %s misbehaved while being timed",
+                   dut_name(modes[i]));
+            ok = false;
+            continue;
+        }
+        report(1, "%-12s %-10s (RMS %.0f%%)", dut_name(modes[i]),
+               complexity_name(big_o), rms * 100);
+    }
+    set_cautious_mode(true);
+    return ok && !error_check();
+}
+
+/* Report what the cycle counter used by simulation and complexity can tell */
+static bool do_timer(int argc, char *argv[])
+{
+    if (argc != 1) {
+        report(1, "%s takes no arguments", argv[0]);
+        return false;
+    }
+
+    const cpucycles_info_t *info = cpucycles_calibrate();
+    report(1, "Counter: %.3f ticks/ns, resolution %ld ticks (%.1f ns)",
+           info->ticks_per_ns, (long) info->resolution,
+           info->resolution / info->ticks_per_ns);
+    report(1, "Overhead: %ld ticks (%.1f ns), subtracted from measurements",
+           (long) info->overhead, info->overhead / info->ticks_per_ns);
+    return true;
+}
+
+#ifdef ENABLE_STATS
+/* Report the work counted for every queue operation so far */
+static bool do_stats(int argc, char *argv[])
+{
+    if (argc == 2 && !strcmp(argv[1], "reset")) {
+        stats_reset();
+        return true;
+    }
+    if (argc != 1) {
+        report(1, "%s takes no arguments, or 'reset'", argv[0]);
+        return false;
+    }
+
+    stats_report(false);
+    return true;
+}
+#endif
+
+static bool do_entropy(int argc, char *argv[])
+{
+    if (argc != 1) {
+        report(1, "%s takes no arguments", argv[0]);
+        return false;
+    }
+
+    if (!current || !current->q) {
+        report(3, "Warning: Calling entropy on null queue");
+        return false;
+    }
+    error_check();
+
+    entropy_stream_t st;
+    entropy_stream_init(&st);
+
+    element_t *e;
+    if (exception_setup(true)) {
+        list_for_each_entry (e, current->q, list)
+            entropy_stream_push(&st, (const uint8_t *) e->value);
+    }
+    exception_cancel();
+
+    report(1,
+           "Entropy of %lu elements (%lu bytes): aggregate %3.2f%%, "
+           "mean %3.2f%%",
+           (unsigned long) st.strings, (unsigned long) st.count,
+           entropy_stream_value(&st), entropy_stream_mean(&st));
+    return !error_check();
+}
+
+/* Queue snapshots, as written by "save" and read back by "load".
+ * All integers are in native byte order, so a snapshot written on a machine
+ * of the other endianness is rejected by its version field.
+ *
+ *   char     magic[8]       "LAB0QSNP"
+ *   uint32_t version        SNAPSHOT_VERSION
+ *   uint32_t nqueues
+ *   uint32_t current        index of the current queue in the chain
+ *   then for each queue, in chain order:
+ *     int32_t  id             informative only: loaded queues get new ones
+ *     uint64_t nelements
+ *     then for each element, from head to tail:
+ *       uint32_t length     of the value, without the terminating NUL
+ *       char     value[length]
+ */
+#define SNAPSHOT_MAGIC "LAB0QSNP"
+#define SNAPSHOT_VERSION 1
+
+typedef struct {
+    const uint8_t *p, *end;
+} snapshot_reader_t;
+
+static bool snapshot_read(snapshot_reader_t *r, void *dst, size_t n)
+{
+    if ((size_t) (r->end - r->p) < n)
+        return false;
+    if (dst)
+        memcpy(dst, r->p, n);
+    r->p += n;
+    return true;
+}
+
+/* Walk the whole snapshot without building anything, so that a damaged
+ * file is rejected before the chain is touched.
+ */
+static bool snapshot_check(snapshot_reader_t r, uint32_t *nqueues,
+                           uint32_t *cur)
+{
+    char magic[8];
+    uint32_t version;
+    if (!snapshot_read(&r, magic, sizeof(magic)) ||
+        memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) ||
+        !snapshot_read(&r, &version, sizeof(version)) ||
+        version != SNAPSHOT_VERSION ||
+        !snapshot_read(&r, nqueues, sizeof(*nqueues)) ||
+        !snapshot_read(&r, cur, sizeof(*cur)))
+        return false;
+
+    for (uint32_t i = 0; i < *nqueues; i++) {
+        uint64_t n;
+        if (!snapshot_read(&r, NULL, sizeof(int32_t)) ||
+            !snapshot_read(&r, &n, sizeof(n)) || n > INT_MAX)
+            return false;
+        for (uint64_t j = 0; j < n; j++) {
+            uint32_t len;
+            if (!snapshot_read(&r, &len, sizeof(len)) ||
+                !snapshot_read(&r, NULL, len))
+                return false;
+        }
+    }
+    return r.p == r.end && (!*nqueues || *cur < *nqueues);
+}
+
+static bool do_save(int argc, char *argv[])
+{
+    if (argc != 2) {
+        report(1, "%s needs 1 argument", argv[0]);
+        return false;
+    }
+
+    FILE *f = fopen(argv[1], "wb");
+    if (!f) {
+        report(1, "Could not open '%s' for writing: %s", argv[1],
+               strerror(errno));
+        return false;
+    }
+
+    uint32_t version = SNAPSHOT_VERSION, nqueues = chain.size, cur = 0;
+    queue_contex_t *ctx;
+    list_for_each_entry (ctx, &chain.head, chain) {
+        if (ctx == current)
+            break;
+        cur++;
+    }
+    if (cur == nqueues)
+        cur = 0;
+    fwrite(SNAPSHOT_MAGIC, 1, 8, f);
+    fwrite(&version, sizeof(version), 1, f);
+    fwrite(&nqueues, sizeof(nqueues), 1, f);
+    fwrite(&cur, sizeof(cur), 1, f);
+
+    uint64_t total = 0;
+    list_for_each_entry (ctx, &chain.head, chain) {
+        int32_t id = ctx->id;
+        uint64_t n = 0;
+        struct list_head *node;
+        if (ctx->q) {
+            list_for_each (node, ctx->q)
+                n++;
+        }
+        fwrite(&id, sizeof(id), 1, f);
+        fwrite(&n, sizeof(n), 1, f);
+        total += n;
+
+        element_t *e;
+        if (n) {
+            list_for_each_entry (e, ctx->q, list) {
+                uint32_t len = strlen(e->value);
+                fwrite(&len, sizeof(len), 1, f);
+                fwrite(e->value, 1, len, f);
+            }
+        }
+    }
+
+    bool ok = !ferror(f);
+    if (fclose(f) || !ok) {
+        report(1, "Could not write '%s': %s", argv[1], strerror(errno));
+        return false;
+    }
+    report(2, "Saved %u queues with %lu elements to %s", nqueues,
+           (unsigned long) total, argv[1]);
+    return true;
+}
+
+/* Append the queues of a snapshot to the chain, keeping their ids.  The file
+ * is mapped rather than read, and each list is linked up directly instead of
+ * going through q_insert_tail(), which would copy every value twice.
+ */
+static bool do_load(int argc, char *argv[])
+{
+    if (argc != 2) {
+        report(1, "%s needs 1 argument", argv[0]);
+        return false;
+    }
+
+    int fd = open(argv[1], O_RDONLY);
+    if (fd < 0) {
+        report(1, "Could not open '%s': %s", argv[1], strerror(errno));
+        return false;
+    }
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (!fstat(fd, &st) && st.st_size > 0)
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        report(1, "Could not map '%s'", argv[1]);
+        return false;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    snapshot_reader_t r = {map, (const uint8_t *) map + st.st_size};
+    uint32_t nqueues, cur;
+    if (!snapshot_check(r, &nqueues, &cur)) {
+        munmap(map, st.st_size);
+        report(1, "ERROR: '%s' is not a valid queue snapshot", argv[1]);
+        return false;
+    }
+    r.p += 8 + 3 * sizeof(uint32_t);
+
+    /* Building from a snapshot is not a test of the queue code, so let no
+     * allocation fail on purpose.
+     */
+    int saved_fail_probability = fail_probability;
+    fail_probability = 0;
+
+    bool ok = true;
+    uint64_t total = 0;
+    queue_contex_t *new_current = NULL;
+    for (uint32_t i = 0; ok && i < nqueues; i++) {
+        /* Ids saved from another chain could clash with those of this one */
+        int32_t saved_id;
+        uint64_t n;
+        snapshot_read(&r, &saved_id, sizeof(saved_id));
+        snapshot_read(&r, &n, sizeof(n));
+
+        queue_contex_t *qctx = malloc(sizeof(queue_contex_t));
+        if (!qctx) {
+            ok = false;
+            break;
+        }
+        qctx->q = NULL;
+        if (exception_setup(true)) {
+            STATS_BEGIN(new);
+            qctx->q = q_new();
+            STATS_END();
+        }
+        exception_cancel();
+        if (!qctx->q) {
+            free(qctx);
+            ok = false;
+            break;
+        }
+        qctx->id = chain.size++;
+        qctx->size = 0;
+        list_add_tail(&qctx->chain, &chain.head);
+        if (i == cur)
+            new_current = qctx;
+
+        for (uint64_t j = 0; j < n; j++) {
+            uint32_t len;
+            snapshot_read(&r, &len, sizeof(len));
+            element_t *e = test_malloc(sizeof(element_t));
+            char *value = e ? test_malloc(len + 1) : NULL;
+            if (!value) {
+                test_free(e);
+                ok = false;
+                break;
+            }
+            memcpy(value, r.p, len);
+            value[len] = '\0';
+            r.p += len;
+            e->value = value;
+            list_add_tail(&e->list, qctx->q);
+            qctx->size++;
+        }
+        total += qctx->size;
+    }
+
+    fail_probability = saved_fail_probability;
+    munmap(map, st.st_size);
+
+    if (new_current)
+        current = new_current;
+    if (!ok)
+        report(1, "ERROR: Ran out of memory loading '%s'", argv[1]);
+    else
+        report(2, "Loaded %u queues with %lu elements from %s", nqueues,
+               (unsigned long) total, argv[1]);
+
+    q_show(3);
+    return ok && !error_check();
+}
+
+static bool do_view(int argc, char *argv[])
+{
+    if (argc != 2) {
+        report(1, "%s needs 1 argument", argv[0]);
+        return false;
+    }
+
+    int fd = open(argv[1], O_RDONLY);
+    if (fd < 0) {
+        report(1, "Could not open '%s': %s", argv[1], strerror(errno));
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) || st.st_size == 0) {
+        close(fd);
+        report(1, "Nothing to view in '%s'", argv[1]);
+        return false;
+    }
+
+    /* Reserve one byte past the file, so that a last line without a newline
+     * can be terminated even when the file ends on a page boundary.
+     */
+    size_t size = st.st_size, map_size = size + 1;
+    char *map = mmap(NULL, map_size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map != MAP_FAILED &&
+        mmap(map, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd,
+             0) == MAP_FAILED) {
+        munmap(map, map_size);
+        map = MAP_FAILED;
+    }
+    close(fd);
+    if (map == MAP_FAILED) {
+        report(1, "Could not map '%s'", argv[1]);
+        return false;
+    }
+    madvise(map, size, MADV_SEQUENTIAL);
+    map[size] = '\0';
+
+    size_t n = 0;
+    for (char *p = map, *end = map + size; p < end; n++) {
+        char *eol = memchr(p, '\n', end - p);
+        p = eol ? eol + 1 : end;
+    }
+
+    queue_view_t *v = malloc(sizeof(queue_view_t));
+    element_t *nodes = n <= INT_MAX ? malloc(n * sizeof(element_t)) : NULL;
+    queue_contex_t *qctx = malloc(sizeof(queue_contex_t));
+    struct list_head *q = NULL;
+    if (v && nodes && qctx && exception_setup(true)) {
+        STATS_BEGIN(new);
+        q = q_new();
+        STATS_END();
+    }
+    exception_cancel();
+    if (!q) {
+        free(v);
+        free(nodes);
+        free(qctx);
+        munmap(map, map_size);
+        report(1, "ERROR: Could not allocate a view of %lu elements",
+               (unsigned long) n);
+        return false;
+    }
+
+    /* Link the nodes up in one go rather than through list_add_tail() */
+    char *p = map;
+    for (size_t i = 0; i < n; i++) {
+        char *eol = memchr(p, '\n', map + size - p);
+        if (!eol)
+            eol = map + size;
+        if (eol > p && eol[-1] == '\r')
+            eol[-1] = '\0';
+        *eol = '\0';
+        nodes[i].value = p;
+        nodes[i].list.prev = i ? &nodes[i - 1].list : q;
+        nodes[i].list.next = i + 1 < n ? &nodes[i + 1].list : q;
+        p = eol + 1;
+    }
+    q->next = &nodes[0].list;
+    q->prev = &nodes[n - 1].list;
+
+    v->nodes = nodes;
+    v->n = n;
+    v->map = map;
+    v->map_size = map_size;
+    list_add_tail(&v->list, &views);
+
+    qctx->q = q;
+    qctx->size = n;
+    qctx->id = chain.size++;
+    list_add_tail(&qctx->chain, &chain.head);
+    current = qctx;
+
+    report(2, "Viewing %lu lines of %s", (unsigned long) n, argv[1]);
+    q_show(3);
+    return !error_check();
+}
+
 static bool do_prev(int argc, char *argv[])
 {
     if (argc != 1) {
@@ -1014,7 +2224,10 @@ static bool do_next(int argc, char *argv[])
 
 static void console_init()
 {
-    ADD_COMMAND(new, "Create new queue", "");
+    ADD_COMMAND(new,
+                "Create new queue, kept sorted on every insertion if "
+                "'sorted'",
+                "[sorted]");
     ADD_COMMAND(free, "Delete queue", "");
     ADD_COMMAND(prev, "Switch to previous queue", "");
     ADD_COMMAND(next, "Switch to next queue", "");
@@ -1042,6 +2255,10 @@ static void console_init()
     ADD_COMMAND(dedup, "Delete all nodes that have duplicate string", "");
     ADD_COMMAND(merge, "Merge all the queues into one sorted queue", "");
     ADD_COMMAND(swap, "Swap every two adjacent nodes in queue", "");
+    ADD_COMMAND(sortall, "Sort every queue, in parallel", "");
+    ADD_COMMAND(freeall, "Delete every queue, in parallel", "");
+    ADD_COMMAND(pmerge,
+                "Sort every queue in parallel, and merge them into one", "");
     ADD_COMMAND(ascend,
                 "Remove every node which has a node with a strictly less "
                 "value anywhere to the right side of it",
@@ -1052,6 +2269,24 @@ static void console_init()
                 "");
     ADD_COMMAND(reverseK, "Reverse the nodes of the queue 'K' at a time",
                 "[K]");
+    ADD_COMMAND(entropy,
+                "Report aggregate Shannon entropy of queue without showing it",
+                "");
+    ADD_COMMAND(complexity,
+                "Fit running time of queue operations to a complexity class",
+                "[op ...]");
+    ADD_COMMAND(timer, "Report resolution and overhead of the cycle counter",
+                "");
+#ifdef ENABLE_STATS
+    ADD_COMMAND(stats, "Report the work done by every queue operation",
+                "[reset]");
+#endif
+    ADD_COMMAND(save, "Save all queues to a snapshot file", "file");
+    ADD_COMMAND(load, "Append the queues saved in a snapshot file", "file");
+    ADD_COMMAND(view,
+                "Append a read-only queue of the lines of file, mapped "
+                "rather than copied",
+                "file");
     add_param("length", &string_length, "Maximum length of displayed string",
               NULL);
     add_param("malloc", &fail_probability, "Malloc failure probability percent",
@@ -1060,11 +2295,34 @@ static void console_init()
               "Number of times allow queue operations to return false", NULL);
     add_param("descend", &descend,
               "Sort and merge queue in ascending/descending order", NULL);
+    add_param("randmin", &randstr_min, "Minimum length of RAND strings",
+              randmin_changed);
+    add_param("randmax", &randstr_max, "Maximum length of RAND strings",
+              randmax_changed);
+    add_param("seed", &seed,
+              "Seed for RAND, malloc failures and simulation (0: random)",
+              seed_changed);
+    add_param("cpus", &dudect_cpus,
+              "Cores to run simulation measurements on in parallel (0: all)",
+              NULL);
+    add_param("crop", &dudect_crop,
+              "Judge simulation by cropped and second-order t-tests too",
+              NULL);
+    add_param("threads", &threads,
+              "Threads for sortall, freeall and pmerge (0: one per core)",
+              threads_changed);
+#ifdef ENABLE_STATS
+    add_param("profile", &profile,
+              "Report comparisons and relinks of every sort and merge", NULL);
+#endif
 }
 
 /* Signal handlers */
 static void sigsegv_handler(int sig)
 {
+    /* A worker stops there, and the thread waiting for it reports */
+    tpool_fault();
+
     /* Avoid possible non-reentrant signal function be used in signal handler */
     assert(write(1,
                  "Segmentation fault occurred.  You dereferenced a NULL or "
@@ -1095,19 +2353,35 @@ static bool q_quit(int argc, char *argv[])
     if (current && current->size > BIG_LIST_SIZE)
         set_cautious_mode(false);
 
+    /* Free the queues in parallel when there are several */
+    if (chain.size > 1 && !pool_lost) {
+        queue_task_t *tasks = run_on_all(free_task);
+        if (tasks) {
+            free(tasks);
+            chain_clear();
+        }
+    }
+
     if (exception_setup(true)) {
         struct list_head *cur = chain.head.next;
         while (chain.size > 0) {
             queue_contex_t *qctx = list_entry(cur, queue_contex_t, chain);
             cur = cur->next;
-            q_free(qctx->q);
+            queue_free(qctx);
             free(qctx);
             chain.size--;
         }
     }
 
     exception_cancel();
+    views_release();
+    sorted_release();
     set_cautious_mode(true);
+    tpool_free(pool);
+    pool = NULL;
+#ifdef ENABLE_STATS
+    stats_report(true);
+#endif
 
     size_t bcnt = allocation_check();
     if (bcnt > 0) {
@@ -29,6 +29,7 @@ void q_free(struct list_head *head)
     list_for_each_entry_safe (it, safe, head, list) {
         free(it->value);
         free(it);
+        STATS_COUNT(touches, 1);
     }
     free(head);
 }
@@ -42,6 +43,7 @@ bool q_insert_head(struct list_head *head, char *s)
     if (head && node && val) {
         node->value = val;
         list_add(&node->list, head);
+        STATS_COUNT(touches, 1);
         flag = true;
     } else {
         if (node)
@@ -68,6 +70,7 @@ element_t *q_remove_head(struct list_head *head, char *sp, size_t bufsize)
             sp[bufsize - 1] = 0;
         }
         list_del(head->next);
+        STATS_COUNT(touches, 1);
         return elem;
     }
     return NULL;
@@ -89,14 +92,17 @@ int q_size(struct list_head *head)
     struct list_head *pos;
     list_for_each (pos, head)
         ++len;
+    STATS_COUNT(touches, len);
     return len;
 }
 
-#define q_find_mid(head, mid, midnext)                                      \
-    mid = (head)->next;                                                     \
-    midnext = (head)->prev;                                                 \
-    for (; mid != midnext && mid->next != midnext; midnext = midnext->prev) \
-        mid = mid->next;
+#define q_find_mid(head, mid, midnext)                                        \
+    mid = (head)->next;                                                       \
+    midnext = (head)->prev;                                                   \
+    for (; mid != midnext && mid->next != midnext; midnext = midnext->prev) { \
+        mid = mid->next;                                                      \
+        STATS_COUNT(touches, 2);                                              \
+    }
 
 /* Delete the middle node in queue */
 bool q_delete_mid(struct list_head *head)
@@ -126,6 +132,7 @@ bool q_delete_somthing(struct list_head *head, int condition)
             if ((k >> 7) - (-k >> 7) != !!condition)
                 break;
             right = reverse ? right->prev : right->next;
+            STATS_COUNT(touches, 1);
         }
         if (!condition &&
             !strcmp(list_entry(left, element_t, list)->value,
@@ -135,6 +142,7 @@ bool q_delete_somthing(struct list_head *head, int condition)
              tmp != right; tmp = reverse ? left->prev : left->next) {
             list_del(tmp);
             q_release_element(list_entry(tmp, element_t, list));
+            STATS_COUNT(touches, 1);
         }
         if (right == head)
             break;
@@ -182,6 +190,7 @@ void q_reverse(struct list_head *head)
         now->next = now->prev;
         now->prev = tmp;
         now = tmp;
+        STATS_COUNT(touches, 1);
     } while (now != head);
 }
 
@@ -193,8 +202,10 @@ void q_reverseK(struct list_head *head, int k)
     struct list_head *prev, *left = head->next, *right, *next;
     do {
         right = left;
-        for (int i = k; --i && right->next != head;)
+        for (int i = k; --i && right->next != head;) {
             right = right->next;
+            STATS_COUNT(touches, 1);
+        }
         prev = left->prev;
         next = right->next;
         struct list_head tmp_head;
@@ -228,17 +239,22 @@ void q_merge_two(struct list_head *head,
         (*node)->prev = *indirect;
         (*indirect)->next = *node;
         indirect = &(*indirect)->next;
+        STATS_COUNT(touches, 1);
+        STATS_COUNT(relinks, 2);
     }
     node = head1 == head ? &another : &head;
     if (head1 == head)
         head1 = head2;
     head1->prev = *indirect;
     (*indirect)->next = head1;
-    for (; head1->next != *node;)
+    for (; head1->next != *node;) {
         head1 = head1->next;
+        STATS_COUNT(touches, 1);
+    }
     head1->next = head;
     head->prev = head1;
     INIT_LIST_HEAD(another);
+    STATS_COUNT(relinks, 6);
 }
 
 /* Sort elements of queue in ascending/descending order */
@@ -256,6 +272,7 @@ void q_sort(struct list_head *head, bool descend)
     head2.next = midnext;
     mid->next = head;
     head->prev = mid;
+    STATS_COUNT(relinks, 6);
     q_sort(head, descend);
     q_sort(&head2, descend);
     q_merge_two(head, &head2, descend);
@@ -277,37 +294,87 @@ int q_descend(struct list_head *head)
     return q_size(head);
 }
 
+/* Pool of threads q_merge() merges pairs of queues on, if any */
+static tpool_t *merge_pool;
+
+void q_merge_pool(tpool_t *pool)
+{
+    merge_pool = pool;
+}
+
+/* Merge queue b, sorted as a is, into a */
+static void merge_pair(struct list_head *a, struct list_head *b, bool descend)
+{
+    if (!a || !b || list_empty(b))
+        return;
+    if (list_empty(a)) {
+        list_splice_init(b, a);
+        STATS_COUNT(relinks, 6);
+    } else {
+        q_merge_two(a, b, descend);
+    }
+}
+
+typedef struct {
+    tpool_task_t task;
+    struct list_head *first;
+    int count;
+    bool descend;
+} merge_task_t;
+
+static void merge_range(struct list_head *first, int count, bool descend);
+
+static void merge_range_task(tpool_task_t *task)
+{
+    merge_task_t *t = container_of(task, merge_task_t, task);
+    STATS_ATTACH(merge);
+    merge_range(t->first, t->count, t->descend);
+    STATS_DETACH();
+}
+
+/* Merge the count queues of the chain from first on into the first of them,
+ * as a tree of merges of pairs: 1+2, 3+4, ..., then (1+2)+(3+4) and so on.
+ * Merges of disjoint ranges are independent, so the first half of every
+ * range is merged on another thread while this one does the second.
+ */
+static void merge_range(struct list_head *first, int count, bool descend)
+{
+    if (count < 2)
+        return;
+
+    int half = count / 2;
+    struct list_head *mid = first;
+    for (int i = 0; i < half; i++)
+        mid = mid->next;
+
+    if (merge_pool && half > 1) {
+        merge_task_t left = {.first = first, .count = half, .descend = descend};
+        tpool_task_init(&left.task, merge_range_task);
+        tpool_spawn(merge_pool, &left.task);
+        merge_range(mid, count - half, descend);
+        tpool_join(merge_pool, &left.task);
+    } else {
+        merge_range(first, half, descend);
+        merge_range(mid, count - half, descend);
+    }
+    merge_pair(list_entry(first, queue_contex_t, chain)->q,
+               list_entry(mid, queue_contex_t, chain)->q, descend);
+}
+
 /* Merge all the queues into one sorted queue, which is in ascending/descending
  * order */
 int q_merge(struct list_head *head, bool descend)
 {
-    if (!head)
+    if (!head || list_empty(head))
         return 0;
-    for (;;) {
-        struct list_head *cur = head->next, *next;
-        for (next = cur->next;
-             next != head &&
-             q_size(list_entry(next, queue_contex_t, chain)->q) == 0;)
-            next = next->next;
-        if (next == head)
-            break;
-    LOOP:
-        q_merge_two(list_entry(cur, queue_contex_t, chain)->q,
-                    list_entry(next, queue_contex_t, chain)->q, descend);
-        list_entry(next, queue_contex_t, chain)->size = 0;
-        for (cur = next->next;
-             cur != head &&
-             q_size(list_entry(cur, queue_contex_t, chain)->q) == 0;)
-            cur = cur->next;
-        if (cur == head)
-            continue;
-        for (next = cur->next;
-             next != head &&
-             q_size(list_entry(next, queue_contex_t, chain)->q) == 0;)
-            next = next->next;
-        if (next != head)
-            goto LOOP;
+
+    merge_range(head->next, q_size(head), descend);
+
+    queue_contex_t *ctx;
+    list_for_each_entry (ctx, head, chain) {
+        if (ctx->chain.prev != head)
+            ctx->size = 0;
     }
-    return list_entry(head->next, queue_contex_t, chain)->size =
-               q_size(list_entry(head->next, queue_contex_t, chain)->q);
-}
\ No newline at end of file
+    queue_contex_t *first = list_first_entry(head, queue_contex_t, chain);
+    return first->size = q_size(first->q);
+}
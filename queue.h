@@ -12,6 +12,7 @@
 
 #include "harness.h"
 #include "list.h"
+#include "taskpool.h"
 
 /**
  * element_t - Linked list element
@@ -250,4 +251,15 @@ int q_descend(struct list_head *head);
  */
 int q_merge(struct list_head *head, bool descend);
 
+/**
+ * q_merge_pool() - Let q_merge() merge pairs of queues in parallel
+ * @pool: pool of threads to run the merges on, or NULL to run them all on
+ * the calling thread
+ *
+ * With a pool set, call q_merge() only from a task of that pool, whose
+ * worker outlives the merges it spawns even if whoever waits for the task
+ * gives up on it.
+ */
+void q_merge_pool(tpool_t *pool);
+
 #endif /* LAB0_QUEUE_H */
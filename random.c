@@ -30,6 +30,8 @@
 
 #include "random.h"
 
+#include <string.h>
+
 #if defined(__linux__) || defined(__GNU__)
 /* We would need to include <linux/random.h>, but not every target has access
  * to the linux headers. We only need RNDGETENTCNT, so we instead inline it.
@@ -266,7 +268,7 @@ static int randombytes_bsd_randombytes(void *buf, size_t n)
     /* We prefer CCRandomGenerateBytes as it returns an error code while
      * arc4random_buf may fail silently on macOS.
      */
-    return (CCRandomGenerateBytes(buf, n) == kCCSuccess);
+    return CCRandomGenerateBytes(buf, n) == kCCSuccess ? 0 : -1;
 #else
     arc4random_buf(buf, n);
     return 0;
@@ -274,7 +276,8 @@ static int randombytes_bsd_randombytes(void *buf, size_t n)
 }
 #endif
 
-int randombytes(uint8_t *buf, size_t n)
+/* Read n bytes of entropy from the operating system */
+static int randombytes_os(uint8_t *buf, size_t n)
 {
 #if defined(__linux__) || defined(__GNU__)
 #if defined(USE_GLIBC)
@@ -293,3 +296,187 @@ int randombytes(uint8_t *buf, size_t n)
 #error "randombytes(...) is not supported on this platform"
 #endif
 }
+
+/* Asking the kernel for every few bytes made generating test inputs
+ * syscall-bound, so randombytes() serves them from a buffer of ChaCha20
+ * output instead, keyed once from the operating system.  After each refill
+ * the first block of output becomes the new key, as in OpenBSD's arc4random,
+ * so bytes already handed out cannot be recomputed from the state.
+ */
+#define CHACHA_KEY_SIZE 32
+#define CHACHA_BLOCK_SIZE 64
+#define RANDOM_BUF_SIZE (64 * CHACHA_BLOCK_SIZE)
+
+static struct {
+    uint32_t key[CHACHA_KEY_SIZE / 4];
+    uint64_t counter;
+    uint8_t buf[RANDOM_BUF_SIZE];
+    size_t avail; /* Unused bytes at the end of buf */
+    int seeded;
+    int fixed; /* Keyed from a seed rather than the operating system */
+} rng;
+
+#define ROTL32(x, n) ((uint32_t) ((x) << (n)) | ((x) >> (32 - (n))))
+
+#define QUARTER_ROUND(a, b, c, d) \
+    do {                          \
+        a += b;                   \
+        d = ROTL32(d ^ a, 16);    \
+        c += d;                   \
+        b = ROTL32(b ^ c, 12);    \
+        a += b;                   \
+        d = ROTL32(d ^ a, 8);     \
+        c += d;                   \
+        b = ROTL32(b ^ c, 7);     \
+    } while (0)
+
+/* One 64-byte block of keystream for the current key and counter */
+static void chacha20_block(uint8_t out[CHACHA_BLOCK_SIZE])
+{
+    uint32_t in[16] = {
+        0x61707865, 0x3320646e, 0x79622d32, 0x6b206574, /* "expand 32-byte k" */
+        rng.key[0], rng.key[1], rng.key[2], rng.key[3],
+        rng.key[4], rng.key[5], rng.key[6], rng.key[7],
+        (uint32_t) rng.counter, (uint32_t) (rng.counter >> 32), 0, 0,
+    };
+    uint32_t x[16];
+    for (int i = 0; i < 16; i++)
+        x[i] = in[i];
+
+    for (int i = 0; i < 10; i++) {
+        QUARTER_ROUND(x[0], x[4], x[8], x[12]);
+        QUARTER_ROUND(x[1], x[5], x[9], x[13]);
+        QUARTER_ROUND(x[2], x[6], x[10], x[14]);
+        QUARTER_ROUND(x[3], x[7], x[11], x[15]);
+        QUARTER_ROUND(x[0], x[5], x[10], x[15]);
+        QUARTER_ROUND(x[1], x[6], x[11], x[12]);
+        QUARTER_ROUND(x[2], x[7], x[8], x[13]);
+        QUARTER_ROUND(x[3], x[4], x[9], x[14]);
+    }
+
+    for (int i = 0; i < 16; i++) {
+        uint32_t v = x[i] + in[i];
+        out[4 * i] = (uint8_t) v;
+        out[4 * i + 1] = (uint8_t) (v >> 8);
+        out[4 * i + 2] = (uint8_t) (v >> 16);
+        out[4 * i + 3] = (uint8_t) (v >> 24);
+    }
+    rng.counter++;
+}
+
+static void rng_refill(void)
+{
+    for (size_t i = 0; i < RANDOM_BUF_SIZE; i += CHACHA_BLOCK_SIZE)
+        chacha20_block(rng.buf + i);
+
+    /* Rekey from the start of the buffer, and hand out only the rest */
+    for (int i = 0; i < CHACHA_KEY_SIZE / 4; i++) {
+        const uint8_t *k = rng.buf + 4 * i;
+        rng.key[i] = k[0] | k[1] << 8 | k[2] << 16 | (uint32_t) k[3] << 24;
+    }
+    memset(rng.buf, 0, CHACHA_KEY_SIZE);
+    rng.avail = RANDOM_BUF_SIZE - CHACHA_KEY_SIZE;
+}
+
+/* xoshiro256** by David Blackman and Sebastiano Vigna, see
+ * <https://prng.di.unimi.it/xoshiro256starstar.c>
+ */
+static uint64_t fast_state[4];
+static int fast_seeded;
+
+static inline uint64_t rotl64(uint64_t x, int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+static inline uint64_t xoshiro256ss(void)
+{
+    uint64_t *s = fast_state;
+    uint64_t result = rotl64(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl64(s[3], 45);
+    return result;
+}
+
+void randombytes_fast(uint8_t *buf, size_t n)
+{
+    if (!fast_seeded) {
+        /* An all-zero state would stay zero */
+        do {
+            randombytes((uint8_t *) fast_state, sizeof(fast_state));
+        } while (!(fast_state[0] | fast_state[1] | fast_state[2] |
+                   fast_state[3]));
+        fast_seeded = 1;
+    }
+
+    for (; n >= 8; buf += 8, n -= 8) {
+        uint64_t v = xoshiro256ss();
+        memcpy(buf, &v, 8);
+    }
+    if (n) {
+        uint64_t v = xoshiro256ss();
+        memcpy(buf, &v, n);
+    }
+}
+
+static void rng_rekey(uint8_t seed[CHACHA_KEY_SIZE])
+{
+    memcpy(rng.key, seed, CHACHA_KEY_SIZE);
+    memset(seed, 0, CHACHA_KEY_SIZE);
+    rng.counter = 0;
+    rng.seeded = 1;
+    rng_refill();
+    /* Derive the fast generator from the new key too */
+    fast_seeded = 0;
+}
+
+int randombytes_reseed(void)
+{
+    uint8_t seed[CHACHA_KEY_SIZE];
+    int ret = rng.fixed && rng.seeded ? randombytes(seed, sizeof(seed))
+                                      : randombytes_os(seed, sizeof(seed));
+    if (ret != 0)
+        return -1;
+    rng_rekey(seed);
+    return 0;
+}
+
+void randombytes_set_seed(uint64_t seed)
+{
+    rng.fixed = seed != 0;
+    if (!rng.fixed) {
+        /* Key from the operating system on next use */
+        rng.seeded = 0;
+        fast_seeded = 0;
+        return;
+    }
+
+    uint8_t key[CHACHA_KEY_SIZE] = {0};
+    for (int i = 0; i < 8; i++)
+        key[i] = (uint8_t) (seed >> (8 * i));
+    rng_rekey(key);
+}
+
+int randombytes(uint8_t *buf, size_t n)
+{
+    if (!rng.seeded && randombytes_reseed() != 0)
+        return -1;
+
+    while (n > 0) {
+        if (rng.avail == 0)
+            rng_refill();
+        size_t chunk = n < rng.avail ? n : rng.avail;
+        uint8_t *p = rng.buf + RANDOM_BUF_SIZE - rng.avail;
+        memcpy(buf, p, chunk);
+        memset(p, 0, chunk);
+        rng.avail -= chunk;
+        buf += chunk;
+        n -= chunk;
+    }
+    return 0;
+}
@@ -4,8 +4,28 @@
 #include <stddef.h>
 #include <stdint.h>
 
+/* Fill buf with len bytes from a ChaCha20 generator keyed from the operating
+ * system.  Return 0 on success, or -1 if the key could not be obtained.
+ */
 extern int randombytes(uint8_t *buf, size_t len);
 
+/* Key the generator afresh, e.g. before starting a child process so that
+ * it does not repeat the bytes of its parent or siblings.  Once a seed is
+ * set, the new key comes from the generator itself, keeping runs
+ * reproducible.  Return 0 on success.
+ */
+extern int randombytes_reseed(void);
+
+/* Key the generator from seed, so that it hands out the same bytes on every
+ * run, or again from the operating system if seed is 0.
+ */
+extern void randombytes_set_seed(uint64_t seed);
+
+/* Fill buf with len bytes from xoshiro256**, seeded from randombytes().  Not
+ * for anything secret, but many times faster for bulk test data.
+ */
+extern void randombytes_fast(uint8_t *buf, size_t len);
+
 static inline uint8_t randombit(void)
 {
     uint8_t ret = 0;
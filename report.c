@@ -32,6 +32,7 @@ static volatile int ret = 0;
 /* Default fatal function */
 static void default_fatal_fun()
 {
+    report_flush();
     ret = write(STDOUT_FILENO, fail_buf, strlen(fail_buf) + 1);
     if (logfile)
         fputs(fail_buf, logfile);
@@ -97,37 +98,92 @@ void report_event(message_t msg, char *fmt, ...)
 
 #define BUF_SIZE 4096
 extern int web_connfd;
+
+/* Output of report() and report_noreturn() is formatted once, then handed to
+ * the stdio buffers of verbfile and logfile and to web_buf.  Nothing is
+ * flushed until report_flush() is called at the end of each command, unless
+ * report_flush_always is set.
+ */
+int report_flush_always = 0;
+
+static char web_buf[BUF_SIZE];
+static size_t web_len = 0;
+
+static void web_flush()
+{
+    if (web_connfd && web_len) {
+        web_buf[web_len] = '\0';
+        web_send(web_connfd, web_buf);
+    }
+    web_len = 0;
+}
+
+static void web_append(char *msg, size_t len)
+{
+    if (web_len + len >= BUF_SIZE)
+        web_flush();
+    if (len >= BUF_SIZE) {
+        web_send(web_connfd, msg);
+        return;
+    }
+    memcpy(web_buf + web_len, msg, len);
+    web_len += len;
+}
+
+void report_flush()
+{
+    if (verbfile)
+        fflush(verbfile);
+    if (logfile)
+        fflush(logfile);
+    web_flush();
+}
+
+static void report_vemit(char *fmt, va_list ap, bool newline)
+{
+    char buffer[BUF_SIZE];
+    char *msg = buffer;
+    va_list aq;
+    va_copy(aq, ap);
+    /* Leave room for the newline */
+    int len = vsnprintf(buffer, BUF_SIZE - 1, fmt, ap);
+    if (len >= BUF_SIZE - 1) {
+        msg = malloc_or_fail(len + 2, "report");
+        vsnprintf(msg, len + 1, fmt, aq);
+    }
+    va_end(aq);
+    if (len < 0)
+        return;
+
+    if (newline) {
+        msg[len++] = '\n';
+        msg[len] = '\0';
+    }
+
+    fwrite(msg, 1, len, verbfile);
+    if (logfile)
+        fwrite(msg, 1, len, logfile);
+    if (web_connfd)
+        web_append(msg, len);
+
+    if (msg != buffer)
+        free_block(msg, len + (newline ? 1 : 2));
+
+    if (report_flush_always)
+        report_flush();
+}
+
 void report(int level, char *fmt, ...)
 {
     if (!verbfile)
         init_files(stdout, stdout);
 
-    char buffer[BUF_SIZE];
     if (level <= verblevel) {
         va_list ap;
         va_start(ap, fmt);
-        vfprintf(verbfile, fmt, ap);
-        fprintf(verbfile, "\n");
-        fflush(verbfile);
-        va_end(ap);
-
-        if (logfile) {
-            va_start(ap, fmt);
-            vfprintf(logfile, fmt, ap);
-            fprintf(logfile, "\n");
-            fflush(logfile);
-            va_end(ap);
-        }
-        va_start(ap, fmt);
-        vsnprintf(buffer, BUF_SIZE, fmt, ap);
+        report_vemit(fmt, ap, true);
         va_end(ap);
     }
-    if (web_connfd) {
-        int len = strlen(buffer);
-        buffer[len] = '\n';
-        buffer[len + 1] = '\0';
-        web_send(web_connfd, buffer);
-    }
 }
 
 void report_noreturn(int level, char *fmt, ...)
@@ -135,27 +191,23 @@ void report_noreturn(int level, char *fmt, ...)
     if (!verbfile)
         init_files(stdout, stdout);
 
-    char buffer[BUF_SIZE];
     if (level <= verblevel) {
         va_list ap;
         va_start(ap, fmt);
-        vfprintf(verbfile, fmt, ap);
-        fflush(verbfile);
-        va_end(ap);
-
-        if (logfile) {
-            va_start(ap, fmt);
-            vfprintf(logfile, fmt, ap);
-            fflush(logfile);
-            va_end(ap);
-        }
-        va_start(ap, fmt);
-        vsnprintf(buffer, BUF_SIZE, fmt, ap);
+        report_vemit(fmt, ap, false);
         va_end(ap);
     }
+}
 
-    if (web_connfd)
-        web_send(web_connfd, buffer);
+void report_log(char *fmt, ...)
+{
+    if (!logfile)
+        return;
+    va_list ap;
+    va_start(ap, fmt);
+    vfprintf(logfile, fmt, ap);
+    va_end(ap);
+    fputc('\n', logfile);
 }
 
 /* Functions denoting failures */
@@ -164,6 +216,7 @@ void report_noreturn(int level, char *fmt, ...)
 static void fail_fun(const char *format, const char *msg)
 {
     snprintf(fail_buf, sizeof(fail_buf), format, msg);
+    report_flush();
     /* Tack on return */
     fail_buf[strlen(fail_buf)] = '\n';
     /* Use write to avoid any buffering issues */
@@ -26,6 +26,15 @@ void report(int verblevel, char *fmt, ...);
 /* Like report, but without return character */
 void report_noreturn(int verblevel, char *fmt, ...);
 
+/* Write a line to the logfile only, if there is one */
+void report_log(char *fmt, ...);
+
+/* Output of report functions is buffered until this is called */
+void report_flush();
+
+/* Flush after every message rather than only at command boundaries */
+extern int report_flush_always;
+
 /* Attempt to call malloc.  Fail when returns NULL */
 void *malloc_or_fail(size_t bytes, const char *fun_name);
 
@@ -0,0 +1,202 @@
+#!/usr/bin/env python3
+
+# Synthetic trace generator for benchmarking qtest at scale.
+#
+# Writes a trace that fills a number of queues and then runs a random mix of
+# operations on them.  Keys follow one of several distributions, and every
+# choice comes from --seed, so the same arguments always give the same trace.
+# Random keys are left to qtest's own RAND, made reproducible by emitting
+# "option seed" in the trace.
+
+import argparse
+import random
+import sys
+
+DEFAULT_MIX = "ih=30,it=30,rh=15,rt=15,sort=4,reverse=3,merge=1,size=2"
+OPERATIONS = ("ih", "it", "rh", "rt", "sort", "reverse", "swap", "dm",
+              "size", "merge")
+
+
+def parse_mix(text):
+    mix = {}
+    for item in text.split(","):
+        op, _, weight = item.partition("=")
+        if op not in OPERATIONS:
+            raise argparse.ArgumentTypeError(f"unknown operation '{op}'")
+        try:
+            mix[op] = float(weight) if weight else 1.0
+        except ValueError:
+            raise argparse.ArgumentTypeError(f"bad weight for '{op}'")
+    if not sum(mix.values()) > 0:
+        raise argparse.ArgumentTypeError("weights must not all be zero")
+    return mix
+
+
+class Keys:
+    """Draw keys from a distribution.  Keys are zero-padded numbers, so that
+    their string order matches their numeric order."""
+
+    def __init__(self, rng, kind, distinct, zipf_s):
+        self.rng = rng
+        self.kind = kind
+        self.distinct = distinct
+        self.counter = 0
+        if kind == "zipf":
+            weights = [1.0 / (k**zipf_s) for k in range(1, distinct + 1)]
+            total = sum(weights)
+            self.cumulative = []
+            acc = 0.0
+            for w in weights:
+                acc += w / total
+                self.cumulative.append(acc)
+            # Which keys are popular should not follow their order
+            self.names = list(range(distinct))
+            rng.shuffle(self.names)
+
+    def next(self):
+        if self.kind == "sorted":
+            self.counter += 1
+            return f"k{self.counter:010d}"
+        if self.kind == "reverse":
+            self.counter += 1
+            return f"k{10**10 - self.counter:010d}"
+        if self.kind == "dups":
+            return f"k{self.rng.randrange(self.distinct):010d}"
+        if self.kind == "zipf":
+            u = self.rng.random()
+            lo, hi = 0, len(self.cumulative) - 1
+            while lo < hi:
+                mid = (lo + hi) // 2
+                if self.cumulative[mid] < u:
+                    lo = mid + 1
+                else:
+                    hi = mid
+            return f"k{self.names[lo]:010d}"
+        return "RAND"
+
+
+class Trace:
+    """Emit commands, tracking queue lengths and the current queue so that
+    every command is valid when it runs."""
+
+    def __init__(self, out, queues):
+        self.out = out
+        self.sizes = [0] * queues
+        self.current = queues - 1
+        self.pending = None  # (command, key, count) of a run of inserts
+
+    def flush(self):
+        if self.pending:
+            cmd, key, count = self.pending
+            self.out.write(f"{cmd} {key}" + (f" {count}\n" if count > 1 else
+                                             "\n"))
+            self.pending = None
+
+    def emit(self, line):
+        self.flush()
+        self.out.write(line + "\n")
+
+    def switch(self, target):
+        while self.current != target:
+            self.emit("next")
+            self.current = (self.current + 1) % len(self.sizes)
+
+    def insert(self, cmd, key):
+        # Runs of the same key become one command with a count
+        if self.pending and self.pending[:2] == (cmd, key):
+            self.pending = (cmd, key, self.pending[2] + 1)
+        else:
+            self.flush()
+            self.pending = (cmd, key, 1)
+        self.sizes[self.current] += 1
+
+    def merge(self):
+        """Sort every queue, merge them, and make the merged-away ones
+        anew."""
+        n = len(self.sizes)
+        for _ in range(n):
+            self.emit("sort")
+            self.switch((self.current + 1) % n)
+        self.emit("merge")
+        self.sizes = [sum(self.sizes)] + [0] * (n - 1)
+        for _ in range(n - 1):
+            self.emit("new")
+        self.current = n - 1
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Generate a synthetic qtest trace")
+    parser.add_argument("-n", "--ops", type=int, default=100000,
+                        help="operations after the initial fill")
+    parser.add_argument("-s", "--size", type=int, default=10000,
+                        help="initial length of each queue")
+    parser.add_argument("-q", "--queues", type=int, default=1,
+                        help="number of queues")
+    parser.add_argument("-m", "--mix", type=parse_mix, default=DEFAULT_MIX,
+                        help="operation weights, e.g. '%s'" % DEFAULT_MIX)
+    parser.add_argument("-k", "--keys", default="random",
+                        choices=("random", "zipf", "sorted", "reverse",
+                                 "dups"),
+                        help="key distribution")
+    parser.add_argument("-d", "--distinct", type=int, default=1000,
+                        help="distinct keys for zipf and dups")
+    parser.add_argument("--zipf-s", type=float, default=1.1,
+                        help="exponent of the Zipf distribution")
+    parser.add_argument("--seed", type=int, default=1,
+                        help="seed for the trace and for qtest's RAND")
+    parser.add_argument("-o", "--output", help="file to write to")
+    args = parser.parse_args()
+    if args.queues < 1 or args.size < 0 or args.ops < 0 or args.seed <= 0:
+        parser.error("queues must be positive, sizes and counts not "
+                     "negative, and the seed positive")
+
+    rng = random.Random(args.seed)
+    keys = Keys(rng, args.keys, max(1, args.distinct), args.zipf_s)
+    out = open(args.output, "w") if args.output else sys.stdout
+    trace = Trace(out, args.queues)
+    mix = args.mix
+
+    out.write(f"# Generated by gen-trace.py {' '.join(sys.argv[1:])}\n")
+    trace.emit("option fail 0")
+    trace.emit("option malloc 0")
+    trace.emit(f"option seed {args.seed}")
+    for _ in range(args.queues):
+        trace.emit("new")
+
+    for q in range(args.queues):
+        trace.switch(q)
+        if keys.kind == "random":
+            if args.size:
+                trace.emit(f"ih RAND {args.size}")
+                trace.sizes[q] += args.size
+        else:
+            for _ in range(args.size):
+                trace.insert("it", keys.next())
+
+    ops, weights = list(mix), list(mix.values())
+    for _ in range(args.ops):
+        op = rng.choices(ops, weights)[0]
+        if op in ("ih", "it", "rh", "rt", "sort", "reverse", "swap", "dm"):
+            trace.switch(rng.randrange(args.queues))
+        if op in ("rh", "rt", "dm") and trace.sizes[trace.current] == 0:
+            op = "it"
+        if op in ("ih", "it"):
+            trace.insert(op, keys.next())
+        elif op in ("rh", "rt", "dm"):
+            trace.emit(op)
+            trace.sizes[trace.current] -= 1
+        elif op == "merge":
+            trace.merge()
+        else:
+            trace.emit(op)
+
+    for _ in range(args.queues):
+        trace.emit("free")
+    trace.flush()
+    if out is not sys.stdout:
+        out.close()
+
+
+if __name__ == "__main__":
+    main()
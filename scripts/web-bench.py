@@ -0,0 +1,127 @@
+#!/usr/bin/env python3
+
+# Load test for the web server built into qtest.
+#
+# Spawns qtest with its web server (unless --no-spawn is given), then has
+# several clients issue commands over keep-alive connections concurrently and
+# reports throughput and latency percentiles.  With --batch, each request is a
+# POST whose body holds that many command lines, run back to back.
+
+import argparse
+import http.client
+import socket
+import subprocess
+import threading
+import time
+
+
+def wait_for_port(port, timeout=5.0):
+    deadline = time.time() + timeout
+    while time.time() < deadline:
+        try:
+            with socket.create_connection(("127.0.0.1", port), timeout=0.1):
+                return True
+        except OSError:
+            time.sleep(0.05)
+    return False
+
+
+def client(port, command, requests, batch, latencies, errors):
+    conn = http.client.HTTPConnection("127.0.0.1", port)
+    body = None
+    if batch:
+        body = (command.strip("/").replace("/", " ") + "\n") * batch
+    for _ in range(requests):
+        start = time.perf_counter()
+        try:
+            if body:
+                conn.request("POST", "/", body)
+            else:
+                conn.request("GET", command)
+            resp = conn.getresponse()
+            resp.read()
+            if resp.status != 200:
+                errors.append(resp.status)
+        except (OSError, http.client.HTTPException) as e:
+            errors.append(e)
+            conn.close()
+            conn = http.client.HTTPConnection("127.0.0.1", port)
+            continue
+        latencies.append(time.perf_counter() - start)
+    conn.close()
+
+
+def percentile(values, p):
+    if not values:
+        return 0.0
+    k = min(len(values) - 1, int(round(p / 100.0 * (len(values) - 1))))
+    return values[k]
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Load test qtest's web server")
+    parser.add_argument("-p", "--port", type=int, default=9999)
+    parser.add_argument("-c", "--clients", type=int, default=8,
+                        help="number of concurrent connections")
+    parser.add_argument("-n", "--requests", type=int, default=2000,
+                        help="requests per connection")
+    parser.add_argument("-C", "--command", default="/size",
+                        help="request path, e.g. /it/abc or /size")
+    parser.add_argument("-b", "--batch", type=int, default=0,
+                        help="send the command this many times per POST")
+    parser.add_argument("-q", "--qtest", default="./qtest")
+    parser.add_argument("--no-spawn", action="store_true",
+                        help="use a qtest web server that is already running")
+    args = parser.parse_args()
+
+    proc = None
+    if not args.no_spawn:
+        proc = subprocess.Popen([args.qtest, "-v", "0"],
+                                stdin=subprocess.PIPE,
+                                stdout=subprocess.DEVNULL)
+        proc.stdin.write(("option fail 0\noption malloc 0\nnew\nweb %d\n" %
+                          args.port).encode())
+        proc.stdin.flush()
+    if not wait_for_port(args.port):
+        print("qtest web server is not listening on port %d" % args.port)
+        if proc:
+            proc.kill()
+        return 1
+
+    latencies = []
+    errors = []
+    threads = [threading.Thread(target=client,
+                                args=(args.port, args.command, args.requests,
+                                      args.batch, latencies, errors))
+               for _ in range(args.clients)]
+    start = time.perf_counter()
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    elapsed = time.perf_counter() - start
+
+    if proc:
+        try:
+            conn = http.client.HTTPConnection("127.0.0.1", args.port)
+            conn.request("GET", "/quit")
+            conn.getresponse().read()
+        except (OSError, http.client.HTTPException):
+            pass
+        proc.stdin.close()
+        proc.wait()
+
+    latencies.sort()
+    total = len(latencies)
+    print("%d requests over %d connections in %.3f s: %.0f req/s, %d errors" %
+          (total, args.clients, elapsed, total / elapsed, len(errors)))
+    if args.batch:
+        print("  %.0f commands/s" % (total * args.batch / elapsed))
+    for p in (50, 90, 99, 99.9):
+        print("  p%-5s %8.3f ms" % (p, percentile(latencies, p) * 1e3))
+    print("  max    %8.3f ms" % (latencies[-1] * 1e3 if latencies else 0.0))
+    return 1 if errors else 0
+
+
+if __name__ == "__main__":
+    exit(main())
@@ -5,30 +5,135 @@
 /* Precalculated log2 realization */
 #include "log2_lshift16.h"
 
+#include "shannon_entropy.h"
+
 /* Shannon full integer entropy calculation */
 #define BUCKET_SIZE (1 << 8)
 
+static inline uint64_t entropy_term(uint64_t p)
+{
+    return -p * log2_lshift16(p);
+}
+
+static inline double entropy_percent(uint64_t entropy_sum)
+{
+    const uint64_t entropy_max = 8 * LOG2_RET_SHIFT;
+    entropy_sum /= LOG2_ARG_SHIFT;
+    return entropy_sum * 100.0 / entropy_max;
+}
+
+/* Entropy of s using bucket as scratch histogram.  bucket must be all zero on
+ * entry and is all zero again on return, so a batch only clears it once.
+ * If acc is not NULL, the byte counts of s are added to it.
+ *
+ * Short strings revisit their own bytes to find the non-empty buckets rather
+ * than scanning all of them.  Long strings are counted into four interleaved
+ * histograms so that runs of the same byte do not serialize on one counter;
+ * the merge loop over the banks is left to the compiler to vectorize.
+ */
+static double entropy_of(const uint8_t *s, uint32_t *bucket, uint64_t *acc)
+{
+    const uint64_t count = strlen((const char *) s);
+    if (!count)
+        return 0.0;
+
+    const uint64_t scale = LOG2_ARG_SHIFT / count;
+    uint64_t entropy_sum = 0;
+
+    if (count <= BUCKET_SIZE) {
+        for (uint64_t i = 0; i < count; i++)
+            bucket[s[i]]++;
+        for (uint64_t i = 0; i < count; i++) {
+            uint32_t n = bucket[s[i]];
+            if (!n)
+                continue;
+            if (acc)
+                acc[s[i]] += n;
+            entropy_sum += entropy_term(n * scale);
+            bucket[s[i]] = 0;
+        }
+        return entropy_percent(entropy_sum);
+    }
+
+    uint32_t banks[3][BUCKET_SIZE];
+    memset(banks, 0, sizeof(banks));
+
+    uint64_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        bucket[s[i]]++;
+        banks[0][s[i + 1]]++;
+        banks[1][s[i + 2]]++;
+        banks[2][s[i + 3]]++;
+    }
+    for (; i < count; i++)
+        bucket[s[i]]++;
+
+    for (uint32_t j = 0; j < BUCKET_SIZE; j++)
+        bucket[j] += banks[0][j] + banks[1][j] + banks[2][j];
+
+    for (uint32_t j = 0; j < BUCKET_SIZE; j++) {
+        if (bucket[j]) {
+            if (acc)
+                acc[j] += bucket[j];
+            entropy_sum += entropy_term(bucket[j] * scale);
+            bucket[j] = 0;
+        }
+    }
+    return entropy_percent(entropy_sum);
+}
+
 double shannon_entropy(const uint8_t *s)
 {
     assert(s);
-    const uint64_t count = strlen((char *) s);
-    uint64_t entropy_sum = 0;
-    const uint64_t entropy_max = 8 * LOG2_RET_SHIFT;
+    uint32_t bucket[BUCKET_SIZE];
+    memset(&bucket, 0, sizeof(bucket));
+    return entropy_of(s, bucket, NULL);
+}
 
-    uint32_t bucket[256];
+void shannon_entropy_batch(const uint8_t *const *s, size_t n, double *out)
+{
+    uint32_t bucket[BUCKET_SIZE];
     memset(&bucket, 0, sizeof(bucket));
+    for (size_t i = 0; i < n; i++) {
+        assert(s[i]);
+        out[i] = entropy_of(s[i], bucket, NULL);
+    }
+}
 
-    for (uint32_t i = 0; i < count; i++)
-        bucket[s[i]]++;
+void entropy_stream_init(entropy_stream_t *st)
+{
+    memset(st, 0, sizeof(*st));
+}
 
+void entropy_stream_push(entropy_stream_t *st, const uint8_t *s)
+{
+    assert(s);
+    uint32_t bucket[BUCKET_SIZE];
+    memset(&bucket, 0, sizeof(bucket));
+
+    st->sum += entropy_of(s, bucket, st->bucket);
+    st->count += strlen((const char *) s);
+    st->strings++;
+}
+
+double entropy_stream_value(const entropy_stream_t *st)
+{
+    if (!st->count)
+        return 0.0;
+
+    /* Unlike the per-string path, scale each count individually so that
+     * streams longer than LOG2_ARG_SHIFT bytes do not collapse to zero.
+     */
+    uint64_t entropy_sum = 0;
     for (uint32_t i = 0; i < BUCKET_SIZE; i++) {
-        if (bucket[i]) {
-            uint64_t p = bucket[i];
-            p *= LOG2_ARG_SHIFT / count;
-            entropy_sum += -p * log2_lshift16(p);
-        }
+        if (st->bucket[i])
+            entropy_sum +=
+                entropy_term(st->bucket[i] * LOG2_ARG_SHIFT / st->count);
     }
+    return entropy_percent(entropy_sum);
+}
 
-    entropy_sum /= LOG2_ARG_SHIFT;
-    return entropy_sum * 100.0 / entropy_max;
+double entropy_stream_mean(const entropy_stream_t *st)
+{
+    return st->strings ? st->sum / st->strings : 0.0;
 }
@@ -0,0 +1,37 @@
+#ifndef LAB0_SHANNON_ENTROPY_H
+#define LAB0_SHANNON_ENTROPY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Shannon entropy of a string, in percent of the 8 bits per byte maximum */
+double shannon_entropy(const uint8_t *s);
+
+/* Compute the entropy of n strings at once, storing the results into out */
+void shannon_entropy_batch(const uint8_t *const *s, size_t n, double *out);
+
+/* Accumulate entropy over a stream of strings without keeping them around.
+ * @bucket: byte histogram over every string pushed so far
+ * @count: total number of bytes pushed
+ * @strings: number of strings pushed
+ * @sum: sum of the entropy of each individual string
+ */
+typedef struct {
+    uint64_t bucket[1 << 8];
+    uint64_t count;
+    uint64_t strings;
+    double sum;
+} entropy_stream_t;
+
+void entropy_stream_init(entropy_stream_t *st);
+
+/* Fold one more string into the stream */
+void entropy_stream_push(entropy_stream_t *st, const uint8_t *s);
+
+/* Entropy of the byte distribution of everything pushed, in percent */
+double entropy_stream_value(const entropy_stream_t *st);
+
+/* Mean of the entropy of each string pushed, in percent */
+double entropy_stream_mean(const entropy_stream_t *st);
+
+#endif /* LAB0_SHANNON_ENTROPY_H */
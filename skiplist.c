@@ -0,0 +1,193 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The index is infrastructure rather than code under test */
+#define INTERNAL 1
+#include "harness.h"
+
+#include "random.h"
+#include "skiplist.h"
+
+/* Levels above the queue, enough for 4^16 elements */
+#define SL_MAX_LEVEL 16
+
+typedef struct tower {
+    element_t *e;
+    int height;
+    struct tower *next[]; /* next[l]: next tower higher than l */
+} tower_t;
+
+struct skiplist {
+    struct list_head *q;
+    bool descend;
+    int level; /* Height of the highest tower */
+    tower_t *first[SL_MAX_LEVEL];
+};
+
+static inline int cmp(const skiplist_t *sl, const char *a, const char *b)
+{
+    int c = strcmp(a, b);
+    return sl->descend ? -c : c;
+}
+
+/* 0 with probability 3/4, 1 with probability 3/16, and so on */
+static int random_height(void)
+{
+    uint64_t bits;
+    randombytes_fast((uint8_t *) &bits, sizeof(bits));
+    int h = bits ? __builtin_ctzll(bits) / 2 : SL_MAX_LEVEL;
+    return h < SL_MAX_LEVEL ? h : SL_MAX_LEVEL;
+}
+
+static tower_t *tower_new(element_t *e, int height)
+{
+    tower_t *t = malloc(sizeof(tower_t) + height * sizeof(tower_t *));
+    if (t) {
+        t->e = e;
+        t->height = height;
+    }
+    return t;
+}
+
+/* Every tower is on the lowest level */
+static void free_towers(skiplist_t *sl)
+{
+    for (tower_t *t = sl->first[0], *next; t; t = next) {
+        next = t->next[0];
+        free(t);
+    }
+    memset(sl->first, 0, sizeof(sl->first));
+    sl->level = 0;
+}
+
+skiplist_t *sl_new(struct list_head *q, bool descend)
+{
+    skiplist_t *sl = malloc(sizeof(skiplist_t));
+    if (!sl)
+        return NULL;
+    sl->q = q;
+    sl->level = 0;
+    memset(sl->first, 0, sizeof(sl->first));
+    sl_rebuild(sl, descend);
+    return sl;
+}
+
+void sl_free(skiplist_t *sl)
+{
+    if (!sl)
+        return;
+    free_towers(sl);
+    free(sl);
+}
+
+bool sl_descend(const skiplist_t *sl)
+{
+    return sl->descend;
+}
+
+void sl_rebuild(skiplist_t *sl, bool descend)
+{
+    free_towers(sl);
+    sl->descend = descend;
+
+    /* The last tower so far at each level */
+    tower_t *last[SL_MAX_LEVEL] = {NULL};
+    element_t *e;
+    list_for_each_entry (e, sl->q, list) {
+        int h = random_height();
+        tower_t *t = h ? tower_new(e, h) : NULL;
+        if (!t)
+            continue;
+        for (int l = 0; l < h; l++) {
+            t->next[l] = NULL;
+            if (last[l])
+                last[l]->next[l] = t;
+            else
+                sl->first[l] = t;
+            last[l] = t;
+        }
+        if (h > sl->level)
+            sl->level = h;
+    }
+}
+
+void sl_insert(skiplist_t *sl, element_t *e)
+{
+    /* The last tower not after e at each level, NULL for none */
+    tower_t *update[SL_MAX_LEVEL];
+    tower_t *x = NULL;
+    for (int l = sl->level - 1; l >= 0; l--) {
+        tower_t *next = x ? x->next[l] : sl->first[l];
+        while (next && cmp(sl, next->e->value, e->value) <= 0) {
+            x = next;
+            next = x->next[l];
+        }
+        update[l] = x;
+    }
+
+    /* No tower between x and the position of e, so only a few elements.
+     * Step over e itself, which is still on the queue.
+     */
+    struct list_head *pos = x ? &x->e->list : sl->q;
+    while (pos->next != sl->q &&
+           (pos->next == &e->list ||
+            cmp(sl, list_entry(pos->next, element_t, list)->value,
+                e->value) <= 0))
+        pos = pos->next;
+    /* Only moved once its place is known, so an exception during the search
+     * leaves it on the queue
+     */
+    if (pos != &e->list)
+        list_move(&e->list, pos);
+
+    int h = random_height();
+    tower_t *t = h ? tower_new(e, h) : NULL;
+    if (!t)
+        return;
+    for (int l = 0; l < h; l++) {
+        tower_t *prev = l < sl->level ? update[l] : NULL;
+        tower_t **link = prev ? &prev->next[l] : &sl->first[l];
+        t->next[l] = *link;
+        *link = t;
+    }
+    if (h > sl->level)
+        sl->level = h;
+}
+
+void sl_forget_first(skiplist_t *sl, element_t *e)
+{
+    tower_t *t = sl->first[0];
+    if (!t || t->e != e)
+        return;
+
+    /* First on the lowest level, so first on all of its own */
+    for (int l = 0; l < t->height; l++)
+        sl->first[l] = t->next[l];
+    free(t);
+    while (sl->level && !sl->first[sl->level - 1])
+        sl->level--;
+}
+
+void sl_forget_last(skiplist_t *sl, element_t *e)
+{
+    tower_t *t = NULL, *x = NULL;
+
+    /* Go to the end of every level.  From the last tower of the level above,
+     * that is only a few towers along.
+     */
+    for (int l = sl->level - 1; l >= 0; l--) {
+        tower_t **link = x ? &x->next[l] : &sl->first[l];
+        while (*link && (*link)->e != e) {
+            x = *link;
+            link = &x->next[l];
+        }
+        if (*link) {
+            t = *link;
+            *link = NULL;
+        }
+    }
+    free(t);
+    while (sl->level && !sl->first[sl->level - 1])
+        sl->level--;
+}
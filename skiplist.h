@@ -0,0 +1,79 @@
+#ifndef LAB0_SKIPLIST_H
+#define LAB0_SKIPLIST_H
+
+/* A skip list index over a sorted queue, so that an element can be inserted
+ * at its sorted position in O(log n) expected time rather than by sorting
+ * the whole queue again.
+ *
+ * The queue itself is the bottom level: its list_head chain is left as it
+ * is, and an element is only given a tower of higher levels with
+ * probability 1/4, then 1/16, and so on (Pugh, CACM 1990).  A search goes
+ * down the towers to the last one not after the value, then along the
+ * queue, on average over fewer than four elements.
+ *
+ * The towers only speed searches up, so an element without one is still
+ * found, but a tower must never outlive its element.  Tell the index about
+ * removals from either end once done, and rebuild it after anything else
+ * has taken elements out of the queue or reordered it.
+ */
+
+#include <stdbool.h>
+
+#include "queue.h"
+
+typedef struct skiplist skiplist_t;
+
+/**
+ * sl_new() - Index a queue
+ * @q: queue, already in the order asked for
+ * @descend: whether the queue is kept in descending order
+ *
+ * Return: NULL for allocation failed
+ */
+skiplist_t *sl_new(struct list_head *q, bool descend);
+
+/**
+ * sl_free() - Free an index, leaving its queue alone
+ * @sl: index to free, or NULL
+ */
+void sl_free(skiplist_t *sl);
+
+/**
+ * sl_descend() - Whether an index keeps its queue in descending order
+ * @sl: index to query
+ */
+bool sl_descend(const skiplist_t *sl);
+
+/**
+ * sl_rebuild() - Index the queue again, in O(n)
+ * @sl: index whose queue changed other than through it
+ * @descend: order the queue is in now
+ */
+void sl_rebuild(skiplist_t *sl, bool descend);
+
+/**
+ * sl_insert() - Move a new element to its sorted position
+ * @sl: index of the queue to insert into
+ * @e: element just added to the front or back of the queue, without a
+ * tower; it goes after those with an equal value
+ *
+ * The element stays on the queue throughout.  Should its tower fail to be
+ * allocated, the element is left in place without one.
+ */
+void sl_insert(skiplist_t *sl, element_t *e);
+
+/**
+ * sl_forget_first() - Drop the tower of an element removed from the front
+ * @sl: index of the queue
+ * @e: element that was first in the queue
+ */
+void sl_forget_first(skiplist_t *sl, element_t *e);
+
+/**
+ * sl_forget_last() - Drop the tower of an element removed from the back
+ * @sl: index of the queue
+ * @e: element that was last in the queue
+ */
+void sl_forget_last(skiplist_t *sl, element_t *e);
+
+#endif /* LAB0_SKIPLIST_H */
@@ -0,0 +1,158 @@
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "dudect/cpucycles.h"
+#include "report.h"
+#include "stats.h"
+
+#ifdef ENABLE_STATS
+
+typedef struct {
+    atomic_uint_least64_t calls;
+    atomic_uint_least64_t cycles;
+    atomic_uint_least64_t touches;
+    atomic_uint_least64_t cmps;
+    atomic_uint_least64_t relinks;
+    atomic_uint_least64_t allocs;
+    atomic_uint_least64_t frees;
+} stats_row_t;
+
+#define _(x) #x,
+static const char *const op_names[N_STATS] = {STAT_OPS};
+#undef _
+
+static stats_row_t rows[N_STATS];
+
+__thread stats_counts_t stats_local;
+
+/* The outermost call the calling thread is in, and where it started */
+static __thread int depth;
+static __thread int cur_op;
+static __thread stats_counts_t start_counts;
+static __thread int64_t start_cycles;
+
+static inline void row_add(atomic_uint_least64_t *v, uint64_t n)
+{
+    atomic_fetch_add_explicit(v, n, memory_order_relaxed);
+}
+
+void stats_attach(int op)
+{
+    if (depth++)
+        return;
+    cur_op = op;
+    start_counts = stats_local;
+}
+
+void stats_detach(void)
+{
+    if (--depth)
+        return;
+    stats_row_t *r = &rows[cur_op];
+    row_add(&r->touches, stats_local.touches - start_counts.touches);
+    row_add(&r->cmps, stats_local.cmps - start_counts.cmps);
+    row_add(&r->relinks, stats_local.relinks - start_counts.relinks);
+    row_add(&r->allocs, stats_local.allocs - start_counts.allocs);
+    row_add(&r->frees, stats_local.frees - start_counts.frees);
+}
+
+void stats_begin(int op)
+{
+    if (depth) {
+        depth++;
+        return;
+    }
+    stats_attach(op);
+    start_cycles = cpucycles_start();
+}
+
+void stats_end(void)
+{
+    if (depth == 1) {
+        int64_t cycles = cpucycles_end() - start_cycles;
+        row_add(&rows[cur_op].calls, 1);
+        row_add(&rows[cur_op].cycles, cycles > 0 ? cycles : 0);
+    }
+    stats_detach();
+}
+
+void stats_abandon(void)
+{
+    if (!depth)
+        return;
+    depth = 1;
+    stats_end();
+}
+
+static uint64_t row_get(atomic_uint_least64_t *v)
+{
+    return atomic_load_explicit(v, memory_order_relaxed);
+}
+
+void stats_get(int op, stats_counts_t *counts)
+{
+    stats_row_t *r = &rows[op];
+    counts->touches = row_get(&r->touches);
+    counts->cmps = row_get(&r->cmps);
+    counts->relinks = row_get(&r->relinks);
+    counts->allocs = row_get(&r->allocs);
+    counts->frees = row_get(&r->frees);
+}
+
+/* A line of the table, through report() or to the logfile only */
+static void emit(bool to_log, const char *fmt, ...)
+{
+    char line[MAX_CHAR];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(line, sizeof(line), fmt, ap);
+    va_end(ap);
+    if (to_log)
+        report_log("%s", line);
+    else
+        report(1, "%s", line);
+}
+
+void stats_report(bool to_log)
+{
+    /* Every call includes the cost of reading the counter twice */
+    int64_t overhead = cpucycles_calibrate()->overhead;
+
+    emit(to_log, "%-12s %8s %12s %9s %10s %10s %10s %7s %7s", "op", "calls",
+         "cycles", "cyc/call", "touches", "cmps", "relinks", "allocs",
+         "frees");
+    for (int i = 0; i < N_STATS; i++) {
+        stats_row_t *r = &rows[i];
+        uint64_t calls = row_get(&r->calls);
+        if (!calls && !row_get(&r->touches))
+            continue;
+        uint64_t cycles = row_get(&r->cycles);
+        uint64_t spent = overhead > 0 ? calls * overhead : 0;
+        cycles = cycles > spent ? cycles - spent : 0;
+        emit(to_log,
+             "%-12s %8" PRIu64 " %12" PRIu64 " %9" PRIu64 " %10" PRIu64
+             " %10" PRIu64 " %10" PRIu64 " %7" PRIu64 " %7" PRIu64,
+             op_names[i], calls, cycles, calls ? cycles / calls : 0,
+             row_get(&r->touches), row_get(&r->cmps), row_get(&r->relinks),
+             row_get(&r->allocs), row_get(&r->frees));
+    }
+}
+
+void stats_reset(void)
+{
+    for (int i = 0; i < N_STATS; i++) {
+        stats_row_t *r = &rows[i];
+        atomic_store(&r->calls, 0);
+        atomic_store(&r->cycles, 0);
+        atomic_store(&r->touches, 0);
+        atomic_store(&r->cmps, 0);
+        atomic_store(&r->relinks, 0);
+        atomic_store(&r->allocs, 0);
+        atomic_store(&r->frees, 0);
+    }
+}
+
+#endif /* ENABLE_STATS */
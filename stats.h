@@ -0,0 +1,99 @@
+#ifndef LAB0_STATS_H
+#define LAB0_STATS_H
+
+/* Counters of the work done by every queue operation: how often it was
+ * called, the cycles it took, and the elements it touched, the strings it
+ * compared, the links between elements it rewrote and the blocks it
+ * allocated and freed on the way.
+ *
+ * The harness and queue.c bump thread-local counters, which cost an add
+ * each.  The command interpreter brackets every call of a queue operation
+ * with STATS_BEGIN() and STATS_END(), which add what the counters moved by
+ * in between to the totals of the operation.
+ *
+ * All of it is compiled in only with ENABLE_STATS, which the Makefile
+ * defines unless RELEASE=1, and the macros expand to nothing otherwise.
+ */
+
+/* Queue operations the counters are kept for */
+#define STAT_OPS   \
+    _(new)         \
+    _(free)        \
+    _(insert_head) \
+    _(insert_tail) \
+    _(remove_head) \
+    _(remove_tail) \
+    _(size)        \
+    _(delete_mid)  \
+    _(delete_dup)  \
+    _(swap)        \
+    _(reverse)     \
+    _(reverseK)    \
+    _(sort)        \
+    _(ascend)      \
+    _(descend)     \
+    _(merge)
+
+#ifdef ENABLE_STATS
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define _(x) STAT_##x,
+enum {
+    STAT_OPS
+#undef _
+        N_STATS,
+};
+
+typedef struct {
+    uint64_t touches; /* Elements stepped to or through */
+    uint64_t cmps;    /* Calls of strcmp */
+    uint64_t relinks; /* Writes of next and prev, by sort and merge */
+    uint64_t allocs;  /* Blocks allocated by the harness */
+    uint64_t frees;   /* Blocks freed by the harness */
+} stats_counts_t;
+
+/* What the calling thread has done so far */
+extern __thread stats_counts_t stats_local;
+
+/* Start and finish a call of operation op.  Calls nested in another one of
+ * the same thread are counted as part of the outer one.
+ */
+void stats_begin(int op);
+void stats_end(void);
+
+/* Finish the calls of the calling thread, cut short by a longjmp */
+void stats_abandon(void);
+
+/* Count what a worker does on behalf of a call made by another thread */
+void stats_attach(int op);
+void stats_detach(void);
+
+/* Totals of operation op so far, less the counts of calls and cycles */
+void stats_get(int op, stats_counts_t *counts);
+
+/* Print the totals through report(), or to the logfile only */
+void stats_report(bool to_log);
+
+void stats_reset(void);
+
+#define STATS_BEGIN(x) stats_begin(STAT_##x)
+#define STATS_END() stats_end()
+#define STATS_ATTACH(x) stats_attach(STAT_##x)
+#define STATS_DETACH() stats_detach()
+#define STATS_ABANDON() stats_abandon()
+#define STATS_COUNT(field, n) ((void) (stats_local.field += (n)))
+
+#else /* !ENABLE_STATS */
+
+#define STATS_BEGIN(x) ((void) 0)
+#define STATS_END() ((void) 0)
+#define STATS_ATTACH(x) ((void) 0)
+#define STATS_DETACH() ((void) 0)
+#define STATS_ABANDON() ((void) 0)
+#define STATS_COUNT(field, n) ((void) 0)
+
+#endif
+
+#endif /* LAB0_STATS_H */
@@ -0,0 +1,343 @@
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+/* The pool is infrastructure rather than code under test */
+#define INTERNAL 1
+#include "harness.h"
+
+#include "taskpool.h"
+
+/* Keep fields written by different threads on different cache lines */
+#define CACHE_LINE 64
+
+/* Tasks a deque can hold; a power of two */
+#define DEQUE_SIZE 4096
+#define DEQUE_MASK (DEQUE_SIZE - 1)
+
+/* How long the creating thread sleeps between looks at what it waits for:
+ * briefly at first, then twice as long each time, so that a long wait does
+ * not keep taking the core from the workers.
+ */
+#define POLL_MIN_NS 10000
+#define POLL_MAX_NS 1000000
+
+typedef struct {
+    _Alignas(CACHE_LINE) atomic_long top;    /* Next to steal */
+    _Alignas(CACHE_LINE) atomic_long bottom; /* Next to push to */
+    _Atomic(tpool_task_t *) tasks[DEQUE_SIZE];
+} deque_t;
+
+typedef struct {
+    tpool_t *pool;
+    int index;
+    pthread_t thread;
+    uint32_t rng; /* Picks whom to steal from */
+} worker_t;
+
+struct tpool {
+    int threads;
+    /* Deque 0 is the creating thread's, deque i the one of worker i */
+    deque_t *deques;
+    worker_t *workers;
+
+    atomic_int queued;     /* Tasks in the deques */
+    atomic_size_t pending; /* Tasks spawned and not yet done */
+
+    /* Idle workers sleep until a task is queued or the pool stops */
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    atomic_int sleepers;
+    atomic_bool stop;
+    atomic_bool faulted; /* A worker stopped in tpool_fault() */
+};
+
+/* The pool the calling thread works for, and its deque there */
+static __thread tpool_t *self_pool;
+static __thread int self_index;
+
+/* Append at the bottom, by the owner only.  Return false if full. */
+static bool deque_push(deque_t *d, tpool_task_t *task)
+{
+    long b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+    long t = atomic_load_explicit(&d->top, memory_order_acquire);
+    if (b - t >= DEQUE_SIZE)
+        return false;
+    atomic_store_explicit(&d->tasks[b & DEQUE_MASK], task,
+                          memory_order_relaxed);
+    atomic_store_explicit(&d->bottom, b + 1, memory_order_release);
+    return true;
+}
+
+/* Take the newest task, by the owner only, racing stealers for the last */
+static tpool_task_t *deque_take(deque_t *d)
+{
+    long b = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+    atomic_store(&d->bottom, b);
+    long t = atomic_load(&d->top);
+    if (t > b) {
+        /* Empty */
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+        return NULL;
+    }
+
+    tpool_task_t *task =
+        atomic_load_explicit(&d->tasks[b & DEQUE_MASK], memory_order_relaxed);
+    if (t == b) {
+        if (!atomic_compare_exchange_strong(&d->top, &t, t + 1))
+            task = NULL;
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+    }
+    return task;
+}
+
+/* Take the oldest task, from any thread */
+static tpool_task_t *deque_steal(deque_t *d)
+{
+    long t = atomic_load(&d->top);
+    long b = atomic_load(&d->bottom);
+    if (t >= b)
+        return NULL;
+
+    tpool_task_t *task =
+        atomic_load_explicit(&d->tasks[t & DEQUE_MASK], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong(&d->top, &t, t + 1))
+        return NULL;
+    return task;
+}
+
+static void run_task(tpool_t *pool, tpool_task_t *task)
+{
+    task->run(task);
+    /* The task may be gone once done, so do not touch it after */
+    atomic_store_explicit(&task->done, true, memory_order_release);
+    atomic_fetch_sub(&pool->pending, 1);
+}
+
+/* A task for worker w: its own newest, or else the oldest of another */
+static tpool_task_t *find_task(tpool_t *pool, worker_t *w)
+{
+    tpool_task_t *task = deque_take(&pool->deques[w->index]);
+    if (!task) {
+        w->rng ^= w->rng << 13;
+        w->rng ^= w->rng >> 17;
+        w->rng ^= w->rng << 5;
+        int n = pool->threads + 1;
+        for (int i = 0, v = w->rng % n; i < n && !task; i++, v = (v + 1) % n) {
+            if (v != w->index)
+                task = deque_steal(&pool->deques[v]);
+        }
+    }
+    if (task)
+        atomic_fetch_sub(&pool->queued, 1);
+    return task;
+}
+
+static void *worker_main(void *arg)
+{
+    worker_t *w = arg;
+    tpool_t *pool = w->pool;
+    self_pool = pool;
+    self_index = w->index;
+
+    for (;;) {
+        tpool_task_t *task = find_task(pool, w);
+        if (task) {
+            run_task(pool, task);
+            continue;
+        }
+
+        /* Announce the sleep before looking at queued for the last time, so
+         * that a spawn either sees a sleeper to wake or is seen here.
+         */
+        pthread_mutex_lock(&pool->lock);
+        atomic_fetch_add(&pool->sleepers, 1);
+        while (!atomic_load(&pool->queued) && !atomic_load(&pool->stop))
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        atomic_fetch_sub(&pool->sleepers, 1);
+        pthread_mutex_unlock(&pool->lock);
+        if (atomic_load(&pool->stop))
+            return NULL;
+    }
+}
+
+static void poll_sleep(long *ns)
+{
+    struct timespec ts = {.tv_sec = 0, .tv_nsec = *ns};
+    nanosleep(&ts, NULL);
+    if (*ns < POLL_MAX_NS)
+        *ns *= 2;
+}
+
+tpool_t *tpool_new(int threads)
+{
+    if (threads < 1)
+        return NULL;
+
+    tpool_t *pool = malloc(sizeof(tpool_t));
+    if (!pool)
+        return NULL;
+    pool->threads = threads;
+    pool->deques = aligned_alloc(CACHE_LINE, (threads + 1) * sizeof(deque_t));
+    pool->workers = calloc(threads + 1, sizeof(worker_t));
+    if (!pool->deques || !pool->workers) {
+        free(pool->deques);
+        free(pool->workers);
+        free(pool);
+        return NULL;
+    }
+    for (int i = 0; i <= threads; i++) {
+        atomic_init(&pool->deques[i].top, 0);
+        atomic_init(&pool->deques[i].bottom, 0);
+    }
+    atomic_init(&pool->queued, 0);
+    atomic_init(&pool->pending, 0);
+    atomic_init(&pool->sleepers, 0);
+    atomic_init(&pool->stop, false);
+    atomic_init(&pool->faulted, false);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+
+    self_pool = pool;
+    self_index = 0;
+
+    /* Leave the time limit alarm to the creating thread, which expects it */
+    sigset_t block, old;
+    sigemptyset(&block);
+    sigaddset(&block, SIGALRM);
+    pthread_sigmask(SIG_BLOCK, &block, &old);
+    int started = 0;
+    for (int i = 1; i <= threads; i++) {
+        worker_t *w = &pool->workers[i];
+        w->pool = pool;
+        w->index = i;
+        w->rng = 2654435761u * i;
+        if (pthread_create(&w->thread, NULL, worker_main, w))
+            break;
+        started++;
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    if (started < threads) {
+        pool->threads = started;
+        tpool_free(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+void tpool_free(tpool_t *pool)
+{
+    if (!pool)
+        return;
+
+    pthread_mutex_lock(&pool->lock);
+    atomic_store(&pool->stop, true);
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 1; i <= pool->threads; i++)
+        pthread_join(pool->workers[i].thread, NULL);
+
+    if (self_pool == pool)
+        self_pool = NULL;
+    pthread_cond_destroy(&pool->wake);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->workers);
+    free(pool->deques);
+    free(pool);
+}
+
+int tpool_threads(const tpool_t *pool)
+{
+    return pool->threads;
+}
+
+void tpool_task_init(tpool_task_t *task, void (*run)(tpool_task_t *task))
+{
+    task->run = run;
+    atomic_init(&task->done, false);
+}
+
+void tpool_spawn(tpool_t *pool, tpool_task_t *task)
+{
+    atomic_store_explicit(&task->done, false, memory_order_relaxed);
+    atomic_fetch_add(&pool->pending, 1);
+
+    bool worker = self_pool == pool && self_index > 0;
+    deque_t *d = &pool->deques[self_pool == pool ? self_index : 0];
+    long ns = POLL_MIN_NS;
+    while (!deque_push(d, task)) {
+        if (worker) {
+            run_task(pool, task);
+            return;
+        }
+        poll_sleep(&ns);
+    }
+
+    atomic_fetch_add(&pool->queued, 1);
+    if (atomic_load(&pool->sleepers)) {
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_signal(&pool->wake);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+void tpool_join(tpool_t *pool, tpool_task_t *task)
+{
+    if (self_pool != pool || !self_index) {
+        long ns = POLL_MIN_NS;
+        while (!atomic_load_explicit(&task->done, memory_order_acquire))
+            poll_sleep(&ns);
+        return;
+    }
+
+    /* Run other tasks meanwhile, most likely the subtasks of this one */
+    worker_t *w = &pool->workers[self_index];
+    while (!atomic_load_explicit(&task->done, memory_order_acquire)) {
+        /* Once a task faulted, give up on the pool here too, rather than
+         * spin for a task that may never be done
+         */
+        if (atomic_load(&pool->faulted))
+            tpool_fault();
+        tpool_task_t *other = find_task(pool, w);
+        if (other)
+            run_task(pool, other);
+        else
+            sched_yield();
+    }
+}
+
+bool tpool_wait(tpool_t *pool)
+{
+    long ns = POLL_MIN_NS;
+    while (atomic_load(&pool->pending)) {
+        if (atomic_load(&pool->faulted))
+            return false;
+        poll_sleep(&ns);
+    }
+    return true;
+}
+
+bool tpool_idle(tpool_t *pool)
+{
+    return !atomic_load(&pool->pending);
+}
+
+void tpool_fault(void)
+{
+    tpool_t *pool = self_pool;
+    if (!pool || !self_index)
+        return;
+    atomic_store(&pool->faulted, true);
+    for (;;)
+        pause();
+}
+
+bool tpool_faulted(tpool_t *pool)
+{
+    return atomic_load(&pool->faulted);
+}
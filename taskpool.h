@@ -0,0 +1,112 @@
+#ifndef LAB0_TASKPOOL_H
+#define LAB0_TASKPOOL_H
+
+/* A work-stealing pool of threads for running independent pieces of work,
+ * such as one operation on every queue of the chain, in parallel.
+ *
+ * Every worker has a deque of its own (Chase and Lev, SPAA 2005): it pushes
+ * and takes tasks at the bottom without contention, and a worker running out
+ * of tasks steals from the top of another's.  The thread that created the
+ * pool has a deque too, which it only pushes to, so that what it spawns is
+ * spread over the workers by stealing.  A task spawning subtasks and then
+ * joining them keeps running others while it waits, which makes nested
+ * fork-join, such as divide and conquer, safe with any number of workers.
+ *
+ * The creating thread never runs tasks itself: it only waits for them, and
+ * does so by polling, so a time limit may longjmp out of the wait.  No task
+ * can be cancelled, so should tpool_idle() then find some still running,
+ * what they work on and the pool itself belong to them for good: touch
+ * neither again, nor free the pool.  The same goes for a pool one of whose
+ * tasks faulted: its worker stops for good in tpool_fault(), and waits for
+ * the pool end there rather than hang.
+ *
+ * Tasks live wherever the caller puts them, typically in a struct of its own
+ * around a tpool_task_t, so spawning never allocates.
+ */
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+typedef struct tpool tpool_t;
+
+typedef struct tpool_task {
+    void (*run)(struct tpool_task *task);
+    atomic_bool done;
+} tpool_task_t;
+
+/**
+ * tpool_new() - Start a pool of worker threads
+ * @threads: number of workers, at least 1
+ *
+ * Return: NULL if the pool or a thread could not be created
+ */
+tpool_t *tpool_new(int threads);
+
+/**
+ * tpool_free() - Stop the workers and free the pool
+ * @pool: pool with no task left to run, or NULL
+ */
+void tpool_free(tpool_t *pool);
+
+/**
+ * tpool_threads() - Number of workers of a pool
+ * @pool: pool to query
+ */
+int tpool_threads(const tpool_t *pool);
+
+/**
+ * tpool_task_init() - Prepare a task for spawning
+ * @task: task to prepare
+ * @run: function to call with task once a worker picks it up
+ */
+void tpool_task_init(tpool_task_t *task, void (*run)(tpool_task_t *task));
+
+/**
+ * tpool_spawn() - Schedule a task
+ * @pool: pool to run the task on
+ * @task: prepared task, which must stay valid until it is done
+ *
+ * Call from the thread that created the pool or from a task.  Should the
+ * deque of the caller be full, a task runs the new one at once instead, and
+ * the creating thread waits for room.
+ */
+void tpool_spawn(tpool_t *pool, tpool_task_t *task);
+
+/**
+ * tpool_join() - Wait for a spawned task to be done
+ * @pool: pool the task was spawned on
+ * @task: task to wait for
+ */
+void tpool_join(tpool_t *pool, tpool_task_t *task);
+
+/**
+ * tpool_wait() - Wait for every task spawned so far to be done
+ * @pool: pool to wait for
+ *
+ * Return: false if a task faulted, and so may never be done
+ */
+bool tpool_wait(tpool_t *pool);
+
+/**
+ * tpool_idle() - Whether every task spawned so far is done
+ * @pool: pool to query
+ */
+bool tpool_idle(tpool_t *pool);
+
+/**
+ * tpool_fault() - Stop a worker whose task faulted
+ *
+ * Call from the handler of a signal such as SIGSEGV.  On a worker, mark its
+ * pool as faulted and block for good, which keeps the frames of the task,
+ * and of any task it was joining, valid for the tasks that still refer to
+ * them.  Return at once on any other thread.
+ */
+void tpool_fault(void);
+
+/**
+ * tpool_faulted() - Whether a task of a pool faulted
+ * @pool: pool to query
+ */
+bool tpool_faulted(tpool_t *pool);
+
+#endif /* LAB0_TASKPOOL_H */
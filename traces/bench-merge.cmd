@@ -0,0 +1,136 @@
+# Time merging 64 sorted queues, in pairs on the pool of threads
+option fail 0
+option malloc 0
+option seed 1
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+new
+ih RAND 2048
+sortall
+time merge
+size
+free
@@ -0,0 +1,23 @@
+# Count comparisons and relinks of sort and merge, the same on every run
+option fail 0
+option malloc 0
+option seed 1
+option profile 1
+new
+it RAND 50000
+sort
+sort
+reverse
+sort
+new
+it RAND 50000
+sort
+new
+it RAND 50000
+sort
+new
+it RAND 50000
+sort
+merge
+stats
+free
@@ -0,0 +1,173 @@
+# Compare inserting then sorting with keeping the queue sorted on insertion
+option fail 0
+option malloc 0
+option seed 1
+new
+time
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+time
+free
+new sorted
+time
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+it RAND 500
+sort
+time
+size
+free
@@ -2,76 +2,103 @@
  * MIT License.
  */
 
+/* accept4 is a GNU extension on Linux */
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+
 #include <arpa/inet.h> /* inet_ntoa */
 #include <errno.h>
+#include <fcntl.h>
 #include <netinet/tcp.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
+#if defined(__linux__)
+#include <sys/epoll.h>
+#define USE_EPOLL
+#endif
+
+#include "http_parser.h"
+#include "web.h"
+
 #define LISTENQ 1024 /* second argument to listen() */
 #define MAXLINE 1024 /* max length of a line */
-#define BUFSIZE 1024
+#define BUFSIZE 4096 /* initial size of per-connection buffers */
+
+/* Largest request we are willing to buffer before giving up on a client */
+#define MAX_REQUEST (64 * 1024)
+
+/* Events handled per web_process() call */
+#define MAX_EVENTS 64
 
 #ifndef DEFAULT_PORT
 #define DEFAULT_PORT 9999 /* use this port if none given as arg to main() */
 #endif
 
-#if defined(__APPLE__) || defined(__FreeBSD__)
-#define TCP_CORK TCP_NOPUSH
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
 #endif
 
 typedef struct {
-    int fd;            /* descriptor for this buf */
-    int count;         /* unread byte in this buf */
-    char *bufptr;      /* next unread byte in this buf */
-    char buf[BUFSIZE]; /* internal buffer */
-} rio_t;
+    char *data;
+    size_t len;
+    size_t cap;
+} buf_t;
 
+/* Per-connection state.  Connections are non-blocking and kept alive, so
+ * requests may arrive split across reads or several per read, and responses
+ * may only partially fit into the socket buffer.
+ */
 typedef struct {
-    char filename[512];
-    off_t offset; /* for support Range */
-    size_t end;
-} http_request_t;
+    int fd;
+    buf_t in;          /* received bytes not yet consumed by a request */
+    buf_t out;         /* response bytes not yet written */
+    size_t out_pos;    /* first byte of out still to be written */
+    buf_t body;        /* output of the command being run */
+    bool collecting;   /* web_send() appends to body */
+    bool keep_alive;   /* of the request being answered */
+    bool closing;      /* close once out is drained */
+    bool batch;        /* running the command lines of a POST body */
+    bool chunked;      /* batch output uses chunked transfer encoding */
+    size_t batch_left; /* body bytes of the batch not yet consumed */
+    size_t responses;  /* number of responses completed */
+} web_conn_t;
+
+static int listen_fd = -1;
+static int poll_fd = -1;
 
-static void rio_readinitb(rio_t *rp, int fd)
+/* Connections indexed by file descriptor */
+static web_conn_t **conns = NULL;
+static int conns_size = 0;
+
+static bool buf_reserve(buf_t *b, size_t extra)
 {
-    rp->fd = fd;
-    rp->count = 0;
-    rp->bufptr = rp->buf;
+    if (b->len + extra <= b->cap)
+        return true;
+
+    size_t cap = b->cap ? b->cap : BUFSIZE;
+    while (cap < b->len + extra)
+        cap <<= 1;
+    char *data = realloc(b->data, cap);
+    if (!data)
+        return false;
+    b->data = data;
+    b->cap = cap;
+    return true;
 }
 
-/* This is a wrapper for the Unix read() function that transfers min(n, count)
- * bytes from an internal buffer to a user buffer, where n is the number of
- * bytes requested by the user and count is the number of unread bytes in the
- * internal buffer. On entry, rio_read() refills the internal buffer via a call
- * to read() if the internal buffer is empty.
- */
-/* $begin rio_read */
-static ssize_t rio_read(rio_t *rp, char *usrbuf, size_t n)
-{
-    int cnt;
-    while (rp->count <= 0) { /* refill if buf is empty */
-        rp->count = read(rp->fd, rp->buf, sizeof(rp->buf));
-        if (rp->count < 0) {
-            if (errno != EINTR) /* interrupted by sig handler return */
-                return -1;
-        } else if (rp->count == 0) { /* EOF */
-            return 0;
-        } else
-            rp->bufptr = rp->buf; /* reset buffer ptr */
-    }
-
-    /* Copy min(n, rp->count) bytes from internal buf to user buf */
-    cnt = n;
-    if (rp->count < n)
-        cnt = rp->count;
-    memcpy(usrbuf, rp->bufptr, cnt);
-    rp->bufptr += cnt;
-    rp->count -= cnt;
-    return cnt;
+static bool buf_append(buf_t *b, const char *s, size_t n)
+{
+    if (!buf_reserve(b, n))
+        return false;
+    memcpy(b->data + b->len, s, n);
+    b->len += n;
+    return true;
 }
 
 static ssize_t writen(int fd, void *usrbuf, size_t n)
@@ -80,7 +107,7 @@ static ssize_t writen(int fd, void *usrbuf, size_t n)
     char *bufp = usrbuf;
 
     while (nleft > 0) {
-        ssize_t nwritten = write(fd, bufp, nleft);
+        ssize_t nwritten = send(fd, bufp, nleft, MSG_NOSIGNAL);
         if (nwritten <= 0) {
             if (errno == EINTR) { /* interrupted by sig handler return */
                 nwritten = 0;     /* and call write() again */
@@ -93,31 +120,53 @@ static ssize_t writen(int fd, void *usrbuf, size_t n)
     return n;
 }
 
-/* robustly read a text line (buffered) */
-static ssize_t rio_readlineb(rio_t *rp, void *usrbuf, size_t maxlen)
+static web_conn_t *conn_get(int fd)
+{
+    return fd >= 0 && fd < conns_size ? conns[fd] : NULL;
+}
+
+static web_conn_t *conn_new(int fd)
 {
-    char c, *bufp = usrbuf;
+    if (fd >= conns_size) {
+        int size = conns_size ? conns_size : 64;
+        while (size <= fd)
+            size <<= 1;
+        web_conn_t **tmp = realloc(conns, size * sizeof(web_conn_t *));
+        if (!tmp)
+            return NULL;
+        memset(tmp + conns_size, 0, (size - conns_size) * sizeof(*tmp));
+        conns = tmp;
+        conns_size = size;
+    }
 
-    int n;
-    for (n = 1; n < maxlen; n++) {
-        int rc;
-        if ((rc = rio_read(rp, &c, 1)) == 1) {
-            *bufp++ = c;
-            if (c == '\n')
-                break;
-        } else if (rc == 0) {
-            if (n == 1)
-                return 0; /* EOF, no data read */
-            break;        /* EOF, some data was read */
-        } else
-            return -1; /* error */
-    }
-    *bufp = 0;
-    return n;
+    web_conn_t *c = calloc(1, sizeof(web_conn_t));
+    if (!c)
+        return NULL;
+    c->fd = fd;
+    conns[fd] = c;
+    return c;
+}
+
+static void conn_close(web_conn_t *c)
+{
+#ifdef USE_EPOLL
+    epoll_ctl(poll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+#endif
+    close(c->fd);
+    conns[c->fd] = NULL;
+    free(c->in.data);
+    free(c->out.data);
+    free(c->body.data);
+    free(c);
 }
 
 void web_send(int out_fd, char *buf)
 {
+    web_conn_t *c = conn_get(out_fd);
+    if (c && c->collecting) {
+        buf_append(&c->body, buf, strlen(buf));
+        return;
+    }
     writen(out_fd, buf, strlen(buf));
 }
 
@@ -135,12 +184,6 @@ int web_open(int port)
                    sizeof(int)) < 0)
         return -1;
 
-    // 6 is TCP's protocol number
-    // enable this, much faster : 4000 req/s -> 17000 req/s
-    if (setsockopt(listenfd, IPPROTO_TCP, TCP_CORK, (const void *) &optval,
-                   sizeof(int)) < 0)
-        return -1;
-
     /* Listenfd will be an endpoint for all requests to port
        on any IP address for this host */
     memset(&serveraddr, 0, sizeof(serveraddr));
@@ -153,78 +196,377 @@ int web_open(int port)
     /* Make it a listening socket ready to accept connection requests */
     if (listen(listenfd, LISTENQ) < 0)
         return -1;
+
+#ifdef USE_EPOLL
+    if (fcntl(listenfd, F_SETFL, fcntl(listenfd, F_GETFL) | O_NONBLOCK) < 0)
+        return -1;
+    if ((poll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+        return -1;
+    struct epoll_event ev = {.events = EPOLLIN, .data.fd = listenfd};
+    if (epoll_ctl(poll_fd, EPOLL_CTL_ADD, listenfd, &ev) < 0)
+        return -1;
+#else
+    poll_fd = listenfd;
+#endif
+
+    listen_fd = listenfd;
     return listenfd;
 }
 
-static void url_decode(char *src, char *dest, int max)
+int web_pollfd()
+{
+    return poll_fd;
+}
+
+/* Run cmdline and queue its output as the response */
+static void conn_respond(web_conn_t *c, char *cmdline, web_cmd_func_t run)
+{
+    c->body.len = 0;
+    c->collecting = true;
+    if (cmdline)
+        run(c->fd, cmdline);
+    c->collecting = false;
+
+    char header[MAXLINE];
+    int n = snprintf(header, sizeof(header),
+                     "HTTP/1.1 %s\r\nContent-Type: text/plain\r\n"
+                     "Content-Length: %lu\r\n%s\r\n",
+                     cmdline ? "200 OK" : "400 Bad Request",
+                     (unsigned long) c->body.len,
+                     c->keep_alive ? "" : "Connection: close\r\n");
+    if (!buf_append(&c->out, header, n) ||
+        !buf_append(&c->out, c->body.data, c->body.len))
+        c->keep_alive = false;
+    if (!c->keep_alive)
+        c->closing = true;
+    c->responses++;
+}
+
+/* Write as much pending output as the socket takes without blocking.
+ * Return false on a write error.
+ */
+static bool conn_write(web_conn_t *c)
+{
+    while (c->out_pos < c->out.len) {
+        ssize_t n = send(c->fd, c->out.data + c->out_pos,
+                         c->out.len - c->out_pos, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            return false;
+        }
+        c->out_pos += n;
+    }
+
+    /* Keep only what is still to be sent, so that a long batch does not
+     * hold all of its output
+     */
+    if (c->out_pos == c->out.len) {
+        c->out.len = c->out_pos = 0;
+    } else if (c->out_pos) {
+        c->out.len -= c->out_pos;
+        memmove(c->out.data, c->out.data + c->out_pos, c->out.len);
+        c->out_pos = 0;
+    }
+    return true;
+}
+
+/* Move the output collected so far into the response as one chunk, and push
+ * it toward the client right away so that long batches stream.
+ */
+static void conn_chunk(web_conn_t *c)
+{
+    if (!c->body.len)
+        return;
+
+    bool ok = true;
+    if (c->chunked) {
+        char size[32];
+        int n = snprintf(size, sizeof(size), "%lx\r\n",
+                         (unsigned long) c->body.len);
+        ok = buf_append(&c->out, size, n);
+    }
+    ok = ok && buf_append(&c->out, c->body.data, c->body.len);
+    if (c->chunked)
+        ok = ok && buf_append(&c->out, "\r\n", 2);
+    c->body.len = 0;
+
+    /* Nobody is listening any more: drop the rest of the batch */
+    if (!ok || !conn_write(c)) {
+        c->out.len = c->out_pos = 0;
+        c->keep_alive = false;
+        c->closing = true;
+    }
+}
+
+/* Start answering a batch: the status line goes out before any command
+ * runs, and the output follows in chunks as the body is consumed.
+ * Clients without HTTP/1.1 get the raw output, terminated by closing.
+ */
+static void conn_batch_begin(web_conn_t *c, const http_request_t *req)
+{
+    c->keep_alive = req->keep_alive && req->http11;
+    c->chunked = req->http11;
+    c->batch = true;
+    c->batch_left = req->content_length;
+    c->body.len = 0;
+
+    char header[MAXLINE];
+    int n = snprintf(header, sizeof(header),
+                     "%sHTTP/1.1 200 OK\r\nContent-Type: text/plain\r\n"
+                     "%s%s\r\n",
+                     req->expect ? "HTTP/1.1 100 Continue\r\n\r\n" : "",
+                     c->chunked ? "Transfer-Encoding: chunked\r\n" : "",
+                     c->keep_alive ? "" : "Connection: close\r\n");
+    if (!buf_append(&c->out, header, n))
+        c->closing = true;
+}
+
+static void conn_batch_end(web_conn_t *c)
 {
-    char *p = src;
-    char code[3] = {0};
-    while (*p && --max) {
-        if (*p == '%') {
-            memcpy(code, ++p, 2);
-            *dest++ = (char) strtoul(code, NULL, 16);
-            p += 2;
+    conn_chunk(c);
+    if (c->chunked && !buf_append(&c->out, "0\r\n\r\n", 5))
+        c->keep_alive = false;
+    c->batch = false;
+    if (!c->keep_alive)
+        c->closing = true;
+    c->responses++;
+}
+
+/* Run the complete command lines among the len bytes at c->in.data + pos,
+ * which belong to the body of the current batch.  The last line of the body
+ * does not need a newline.  Return the number of bytes consumed.
+ */
+static size_t conn_batch(web_conn_t *c, size_t pos, size_t len,
+                         web_cmd_func_t run)
+{
+    if (len > c->batch_left)
+        len = c->batch_left;
+    bool last = len == c->batch_left;
+
+    size_t used = 0;
+    c->collecting = true;
+    while (!c->closing && used < len) {
+        char *line = c->in.data + pos + used;
+        char *eol = memchr(line, '\n', len - used);
+        size_t n;
+        char *tail = NULL;
+        if (eol) {
+            n = eol - line;
+            *eol = '\0';
+        } else if (last) {
+            /* The bytes after the body belong to the next request */
+            n = len - used;
+            line = tail = strndup(line, n);
+            if (!tail) {
+                c->closing = true;
+                break;
+            }
         } else {
-            *dest++ = *p++;
+            if (len - used > MAX_REQUEST)
+                c->closing = true;
+            break;
         }
+        if (n && line[n - 1] == '\r')
+            line[n - 1] = '\0';
+
+        run(c->fd, line);
+        free(tail);
+        used += eol ? n + 1 : n;
+        if (c->body.len >= BUFSIZE)
+            conn_chunk(c);
+    }
+    c->collecting = false;
+
+    c->batch_left -= used;
+    if (!c->batch_left)
+        conn_batch_end(c);
+    else
+        conn_chunk(c);
+    return used;
+}
+
+/* Write as much pending output as the socket takes.
+ * Return false if the connection was closed.
+ */
+static bool conn_flush(web_conn_t *c)
+{
+    if (!conn_write(c)) {
+        conn_close(c);
+        return false;
     }
-    *dest = '\0';
+
+    bool drained = c->out_pos == c->out.len;
+    if (drained)
+        c->out.len = c->out_pos = 0;
+    if (drained && c->closing) {
+        conn_close(c);
+        return false;
+    }
+
+#ifdef USE_EPOLL
+    struct epoll_event ev = {
+        .events = EPOLLIN | (drained ? 0 : EPOLLOUT),
+        .data.fd = c->fd,
+    };
+    epoll_ctl(poll_fd, EPOLL_CTL_MOD, c->fd, &ev);
+#endif
+    return true;
 }
 
-static void parse_request(int fd, http_request_t *req)
+/* Answer every complete request in the input buffer, in order, and run
+ * whatever command lines of a batch have arrived.
+ */
+static void conn_process(web_conn_t *c, web_cmd_func_t run)
 {
-    rio_t rio;
-    char buf[MAXLINE], method[MAXLINE], uri[MAXLINE];
-    req->offset = 0;
-    req->end = 0; /* default */
+    size_t used = 0;
+    while (!c->closing) {
+        if (c->batch) {
+            size_t n = conn_batch(c, used, c->in.len - used, run);
+            used += n;
+            if (c->batch)
+                break;
+            continue;
+        }
+        if (used == c->in.len)
+            break;
 
-    rio_readinitb(&rio, fd);
-    rio_readlineb(&rio, buf, MAXLINE);
-    sscanf(buf, "%1023s %1023s", method, uri); /* version is not cared */
-    /* read all */
-    while (buf[0] != '\n' && buf[1] != '\n') { /* \n || \r\n */
-        rio_readlineb(&rio, buf, MAXLINE);
-        if (buf[0] == 'R' && buf[1] == 'a' && buf[2] == 'n') {
-            sscanf(buf, "Range: bytes=%lu-%lu", (unsigned long *) &req->offset,
-                   (unsigned long *) &req->end);
-            /* Range: [start, end] */
-            if (req->end != 0)
-                req->end++;
+        http_request_t req;
+        ssize_t n = http_parse_request(c->in.data + used, c->in.len - used,
+                                       MAX_REQUEST, &req);
+        if (n == 0)
+            break;
+        if (n < 0) {
+            c->keep_alive = false;
+            conn_respond(c, NULL, run);
+            break;
         }
+        used += n;
+        if (req.batch) {
+            conn_batch_begin(c, &req);
+            continue;
+        }
+        c->keep_alive = req.keep_alive;
+        conn_respond(c, req.cmd, run);
     }
-    char *filename = uri;
-    if (uri[0] == '/') {
-        filename = uri + 1;
-        int length = strlen(filename);
-        if (length == 0) {
-            filename = ".";
-        } else {
-            for (int i = 0; i < length; ++i) {
-                if (filename[i] == '?') {
-                    filename[i] = '\0';
-                    break;
-                }
-            }
+
+    c->in.len -= used;
+    memmove(c->in.data, c->in.data + used, c->in.len);
+}
+
+/* Read whatever is available.  Return false if the connection was closed. */
+static bool conn_read(web_conn_t *c, web_cmd_func_t run)
+{
+    bool eof = false;
+    for (;;) {
+        if (!buf_reserve(&c->in, BUFSIZE)) {
+            conn_close(c);
+            return false;
         }
+        ssize_t n = read(c->fd, c->in.data + c->in.len, c->in.cap - c->in.len);
+        if (n > 0) {
+            /* Run batches as they arrive rather than buffering them whole */
+            c->in.len += n;
+            conn_process(c, run);
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        eof = true;
+        break;
     }
-    url_decode(filename, req->filename, MAXLINE);
+
+    if (eof)
+        c->closing = true;
+    return conn_flush(c);
 }
 
-char *web_recv(int fd, struct sockaddr_in *clientaddr)
+#ifdef USE_EPOLL
+static void web_accept()
 {
-    http_request_t req;
-    parse_request(fd, &req);
+    for (;;) {
+        struct sockaddr_in clientaddr;
+        socklen_t clientlen = sizeof(clientaddr);
+        int fd = accept4(listen_fd, (struct sockaddr *) &clientaddr,
+                         &clientlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR)
+                continue;
+            return;
+        }
+
+        /* Responses go out in a single write, so do not wait for more */
+        int optval = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &optval, sizeof(optval));
 
-    char *p = req.filename;
-    /* Change '/' to ' ' */
-    while (*p) {
-        ++p;
-        if (*p == '/')
-            *p = ' ';
+        struct epoll_event ev = {.events = EPOLLIN, .data.fd = fd};
+        if (!conn_new(fd) || epoll_ctl(poll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            if (conn_get(fd))
+                conn_close(conn_get(fd));
+            else
+                close(fd);
+        }
     }
-    char *ret = malloc(strlen(req.filename) + 1);
-    strncpy(ret, req.filename, strlen(req.filename) + 1);
+}
 
-    return ret;
+int web_process(web_cmd_func_t run)
+{
+    struct epoll_event events[MAX_EVENTS];
+    int n = epoll_wait(poll_fd, events, MAX_EVENTS, 0);
+    for (int i = 0; i < n; i++) {
+        int fd = events[i].data.fd;
+        if (fd == listen_fd) {
+            web_accept();
+            continue;
+        }
+
+        web_conn_t *c = conn_get(fd);
+        if (!c)
+            continue;
+        if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+            if (!conn_read(c, run))
+                continue;
+        }
+        if (events[i].events & EPOLLOUT)
+            conn_flush(c);
+    }
+    return n;
 }
+#else
+/* Without epoll, fall back to serving one connection per call, blocking
+ * until its first request (or batch) has been answered.
+ */
+int web_process(web_cmd_func_t run)
+{
+    struct sockaddr_in clientaddr;
+    socklen_t clientlen = sizeof(clientaddr);
+    int fd = accept(listen_fd, (struct sockaddr *) &clientaddr, &clientlen);
+    if (fd < 0)
+        return 0;
+
+    web_conn_t *c = conn_new(fd);
+    if (!c) {
+        close(fd);
+        return 0;
+    }
+
+    while (!c->responses && !c->closing) {
+        if (!buf_reserve(&c->in, BUFSIZE))
+            break;
+        ssize_t n = read(fd, c->in.data + c->in.len, c->in.cap - c->in.len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        c->in.len += n;
+        conn_process(c, run);
+    }
+    writen(fd, c->out.data + c->out_pos, c->out.len - c->out_pos);
+    conn_close(c);
+    return 1;
+}
+#endif
@@ -3,9 +3,18 @@
 
 #include <netinet/in.h>
 
+/* Run one command line received on connection fd */
+typedef void (*web_cmd_func_t)(int fd, char *cmdline);
+
 int web_open(int port);
 
-char *web_recv(int fd, struct sockaddr_in *clientaddr);
+/* Descriptor that becomes readable when the server has work to do */
+int web_pollfd();
+
+/* Accept connections and answer every complete request with run.
+ * Return the number of events handled.
+ */
+int web_process(web_cmd_func_t run);
 
 void web_send(int out_fd, char *buffer);
 